@@ -0,0 +1,112 @@
+// Замер MapRenderer::RenderMapObjects на сгенерированных сетях растущего размера.
+// Для каждого удвоения сети выводится показатель роста времени: около 1 — линейный рост, около 2 — квадратичный.
+//
+// Сборка из корня репозитория (см. README):
+//   g++ -std=c++17 -O2 -pthread -Itransport-catalogue bench/render_map_objects_bench.cpp transport-catalogue/{map_renderer,svg,json,thread_pool,transport_catalogue,domain}.cpp -o render_map_objects_bench
+// Запуск: ./render_map_objects_bench [число остановок в наименьшей сети] [число удвоений]
+
+#include "json.h"
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+constexpr size_t STOPS_PER_ROUTE = 40;
+constexpr size_t STOPS_PER_BUS = 5;
+constexpr int REPEATS = 3;
+
+// Остановки разбросаны по прямоугольнику, у маршрута STOPS_PER_ROUTE остановок,
+// а на каждые STOPS_PER_BUS остановок приходится один маршрут
+void FillCatalogue(transport::TransportCatalogue& catalogue, size_t stops_count) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> latitude(55.5, 55.9);
+    std::uniform_real_distribution<double> longitude(37.3, 37.9);
+
+    std::vector<std::string> names;
+    names.reserve(stops_count);
+    for (size_t i = 0; i < stops_count; ++i) {
+        names.push_back("Stop "s + std::to_string(i));
+        catalogue.AddStop({names.back(), {latitude(generator), longitude(generator)}});
+    }
+
+    const size_t buses_count = stops_count / STOPS_PER_BUS;
+    std::vector<std::string_view> route;
+    for (size_t bus = 0; bus < buses_count; ++bus) {
+        route.clear();
+        const size_t start = generator() % stops_count;
+        for (size_t i = 0; i < STOPS_PER_ROUTE; ++i) {
+            route.push_back(names[(start + i * 7 + generator() % 3) % stops_count]);
+        }
+        const bool is_round = bus % 2 == 1;
+        if (is_round) {
+            route.push_back(route.front());
+        }
+        catalogue.AddBus("Bus "s + std::to_string(bus), route, is_round);
+    }
+}
+
+json::Document MakeRenderSettings() {
+    std::istringstream settings(R"({
+        "width": 1200.0, "height": 1200.0, "padding": 50.0, "line_width": 14.0, "stop_radius": 5.0,
+        "bus_label_font_size": 20, "bus_label_offset": [7.0, 15.0],
+        "stop_label_font_size": 20, "stop_label_offset": [7.0, -3.0],
+        "underlayer_color": [255, 255, 255, 0.85], "underlayer_width": 3.0,
+        "color_palette": ["green", [255, 160, 0], "red"]
+    })");
+    return json::Load(settings);
+}
+
+// Лучшее время из нескольких повторов, в секундах
+double MeasureRender(const transport::TransportCatalogue& catalogue) {
+    map_renderer::MapRenderer renderer;
+    renderer.SetSettings(MakeRenderSettings());
+    double best = 0.;
+    for (int i = 0; i < REPEATS; ++i) {
+        renderer.ClearMapObjects();
+        const auto start = std::chrono::steady_clock::now();
+        renderer.RenderMapObjects(catalogue.GetRoutesList());
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const size_t first_stops_count = argc > 1 ? std::stoul(argv[1]) : 5000;
+    const int doublings = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    std::cout << std::setw(8) << "stops"sv << std::setw(8) << "routes"sv << std::setw(12) << "time, ms"sv
+              << std::setw(20) << "ns per route stop"sv << std::setw(10) << "growth"sv << std::endl;
+    double previous_time = 0.;
+    for (int step = 0; step <= doublings; ++step) {
+        const size_t stops_count = first_stops_count << step;
+        transport::TransportCatalogue catalogue;
+        FillCatalogue(catalogue, stops_count);
+        const double time = MeasureRender(catalogue);
+        const size_t route_stops = stops_count / STOPS_PER_BUS * STOPS_PER_ROUTE;
+
+        std::cout << std::setw(8) << stops_count << std::setw(8) << stops_count / STOPS_PER_BUS
+                  << std::setw(12) << std::fixed << std::setprecision(2) << time * 1e3
+                  << std::setw(20) << std::setprecision(1) << time * 1e9 / route_stops;
+        if (step > 0) {
+            std::cout << std::setw(10) << std::setprecision(2) << std::log2(time / previous_time);
+        }
+        std::cout << std::endl;
+        previous_time = time;
+    }
+}
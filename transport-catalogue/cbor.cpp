@@ -0,0 +1,332 @@
+#include "cbor.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std::literals;
+
+namespace cbor {
+
+namespace {
+
+enum MajorType : uint8_t {
+    UNSIGNED = 0,
+    NEGATIVE = 1,
+    BYTES = 2,
+    TEXT = 3,
+    ARRAY = 4,
+    MAP = 5,
+    TAG = 6,
+    SIMPLE = 7,
+};
+
+constexpr uint8_t INDEFINITE = 31;
+constexpr uint8_t SIMPLE_FALSE = 0xF4;
+constexpr uint8_t SIMPLE_TRUE = 0xF5;
+constexpr uint8_t SIMPLE_NULL = 0xF6;
+constexpr uint8_t FLOAT16 = 0xF9;
+constexpr uint8_t FLOAT32 = 0xFA;
+constexpr uint8_t FLOAT64 = 0xFB;
+constexpr uint8_t BREAK = 0xFF;
+
+double HalfToDouble(uint16_t half) {
+    const int exponent = (half >> 10) & 0x1F;
+    const int mantissa = half & 0x3FF;
+    double value = 0.;
+    if (exponent == 0) {
+        value = std::ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+}  // namespace
+
+Writer::Writer(std::ostream& output)
+    : output_(output) {
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+void Writer::Flush() {
+    output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+void Writer::Null() {
+    buffer_.push_back(static_cast<char>(SIMPLE_NULL));
+    AfterValue();
+}
+
+void Writer::Bool(bool value) {
+    buffer_.push_back(static_cast<char>(value ? SIMPLE_TRUE : SIMPLE_FALSE));
+    AfterValue();
+}
+
+void Writer::Int(int value) {
+    if (value >= 0) {
+        AppendHead(UNSIGNED, static_cast<uint64_t>(value));
+    } else {
+        AppendHead(NEGATIVE, static_cast<uint64_t>(-(static_cast<int64_t>(value) + 1)));
+    }
+    AfterValue();
+}
+
+// Число, которое float хранит без потерь, занимает 4 байта вместо 8
+void Writer::Double(double value) {
+    const bool fits_float = std::abs(value) <= std::numeric_limits<float>::max();
+    const float narrow = fits_float ? static_cast<float>(value) : 0.f;
+    if (fits_float && static_cast<double>(narrow) == value) {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &narrow, sizeof(bits));
+        buffer_.push_back(static_cast<char>(FLOAT32));
+        AppendBigEndian(bits, 4);
+    } else {
+        uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        buffer_.push_back(static_cast<char>(FLOAT64));
+        AppendBigEndian(bits, 8);
+    }
+    AfterValue();
+}
+
+void Writer::String(std::string_view value) {
+    AppendHead(TEXT, value.size());
+    buffer_ += value;
+    AfterValue();
+}
+
+void Writer::StartDict() {
+    AppendIndefinite(MAP);
+}
+
+void Writer::Key(std::string_view key) {
+    AppendHead(TEXT, key.size());
+    buffer_ += key;
+}
+
+void Writer::EndDict() {
+    buffer_.push_back(static_cast<char>(BREAK));
+    AfterValue();
+}
+
+void Writer::StartArray() {
+    AppendIndefinite(ARRAY);
+}
+
+void Writer::EndArray() {
+    buffer_.push_back(static_cast<char>(BREAK));
+    AfterValue();
+}
+
+void Writer::Value(const json::Node& node) {
+    json::Emit(node, *this);
+}
+
+// Заголовок элемента: тип в старших трёх битах, аргумент — в младших пяти или в следующих 1, 2, 4, 8 байтах
+void Writer::AppendHead(uint8_t major_type, uint64_t argument) {
+    const uint8_t type_bits = static_cast<uint8_t>(major_type << 5);
+    if (argument < 24) {
+        buffer_.push_back(static_cast<char>(type_bits | argument));
+    } else if (argument <= 0xFF) {
+        buffer_.push_back(static_cast<char>(type_bits | 24));
+        AppendBigEndian(argument, 1);
+    } else if (argument <= 0xFFFF) {
+        buffer_.push_back(static_cast<char>(type_bits | 25));
+        AppendBigEndian(argument, 2);
+    } else if (argument <= 0xFFFFFFFF) {
+        buffer_.push_back(static_cast<char>(type_bits | 26));
+        AppendBigEndian(argument, 4);
+    } else {
+        buffer_.push_back(static_cast<char>(type_bits | 27));
+        AppendBigEndian(argument, 8);
+    }
+}
+
+void Writer::AppendIndefinite(uint8_t major_type) {
+    buffer_.push_back(static_cast<char>((major_type << 5) | INDEFINITE));
+}
+
+void Writer::AppendBigEndian(uint64_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        buffer_.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void Writer::AfterValue() {
+    if (buffer_.size() >= BUFFER_SIZE) {
+        Flush();
+    }
+}
+
+Parser::Parser(std::string_view input)
+    : pos_(input.data())
+    , end_(input.data() + input.size()) {
+}
+
+uint8_t Parser::Get() {
+    if (pos_ == end_) {
+        throw json::ParsingError("Unexpected end of CBOR input."s);
+    }
+    return static_cast<uint8_t>(*pos_++);
+}
+
+uint64_t Parser::ReadArgument(uint8_t additional) {
+    if (additional < 24) {
+        return additional;
+    }
+    if (additional > 27) {
+        throw json::ParsingError("Invalid CBOR argument size."s);
+    }
+    const int bytes = 1 << (additional - 24);
+    uint64_t argument = 0;
+    for (int i = 0; i < bytes; ++i) {
+        argument = (argument << 8) | Get();
+    }
+    return argument;
+}
+
+// Строка неопределённой длины склеивается из частей в scratch_
+std::string_view Parser::ReadText(uint8_t additional) {
+    if (additional != INDEFINITE) {
+        const uint64_t size = ReadArgument(additional);
+        if (size > static_cast<uint64_t>(end_ - pos_)) {
+            throw json::ParsingError("Unexpected end of CBOR input."s);
+        }
+        const std::string_view text(pos_, static_cast<size_t>(size));
+        pos_ += size;
+        return text;
+    }
+
+    std::string text;
+    while (!IsBreak()) {
+        const uint8_t head = Get();
+        if (head >> 5 != TEXT || (head & 0x1F) == INDEFINITE) {
+            throw json::ParsingError("Invalid CBOR text chunk."s);
+        }
+        text += ReadText(head & 0x1F);
+    }
+    scratch_ = std::move(text);
+    return scratch_;
+}
+
+double Parser::ReadFloat(uint8_t additional) {
+    const uint64_t bits = ReadArgument(additional);
+    if (additional == 25) {
+        return HalfToDouble(static_cast<uint16_t>(bits));
+    }
+    if (additional == 26) {
+        const uint32_t narrow_bits = static_cast<uint32_t>(bits);
+        float value = 0.f;
+        std::memcpy(&value, &narrow_bits, sizeof(value));
+        return value;
+    }
+    double value = 0.;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool Parser::IsBreak() {
+    if (pos_ != end_ && static_cast<uint8_t>(*pos_) == BREAK) {
+        ++pos_;
+        return true;
+    }
+    return false;
+}
+
+void Parser::ParseValue(json::Handler& handler) {
+    const uint8_t head = Get();
+    const uint8_t additional = head & 0x1F;
+    switch (head >> 5) {
+        case UNSIGNED: {
+            const uint64_t value = ReadArgument(additional);
+            if (value <= static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+                handler.Int(static_cast<int>(value));
+            } else {
+                handler.Double(static_cast<double>(value));
+            }
+            break;
+        }
+        case NEGATIVE: {
+            const uint64_t value = ReadArgument(additional);
+            if (value <= static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+                handler.Int(-1 - static_cast<int>(value));
+            } else {
+                handler.Double(-1. - static_cast<double>(value));
+            }
+            break;
+        }
+        case TEXT:
+            handler.String(ReadText(additional));
+            break;
+        case ARRAY:
+            ParseArray(additional, handler);
+            break;
+        case MAP:
+            ParseDict(additional, handler);
+            break;
+        case TAG:
+            ReadArgument(additional);
+            ParseValue(handler);
+            break;
+        case SIMPLE:
+            if (head == SIMPLE_FALSE || head == SIMPLE_TRUE) {
+                handler.Bool(head == SIMPLE_TRUE);
+            } else if (head == SIMPLE_NULL) {
+                handler.Null();
+            } else if (head == FLOAT16 || head == FLOAT32 || head == FLOAT64) {
+                handler.Double(ReadFloat(additional));
+            } else {
+                throw json::ParsingError("Unsupported CBOR simple value."s);
+            }
+            break;
+        default:
+            throw json::ParsingError("CBOR byte strings are not supported."s);
+    }
+}
+
+void Parser::ParseDict(uint8_t additional, json::Handler& handler) {
+    const bool indefinite = additional == INDEFINITE;
+    uint64_t size = indefinite ? 0 : ReadArgument(additional);
+    handler.StartDict();
+    while (indefinite ? !IsBreak() : size-- > 0) {
+        const uint8_t head = Get();
+        if (head >> 5 != TEXT) {
+            throw json::ParsingError("Dict key must be a string."s);
+        }
+        handler.Key(ReadText(head & 0x1F));
+        ParseValue(handler);
+    }
+    handler.EndDict();
+}
+
+void Parser::ParseArray(uint8_t additional, json::Handler& handler) {
+    const bool indefinite = additional == INDEFINITE;
+    uint64_t size = indefinite ? 0 : ReadArgument(additional);
+    handler.StartArray();
+    while (indefinite ? !IsBreak() : size-- > 0) {
+        ParseValue(handler);
+    }
+    handler.EndArray();
+}
+
+json::Document Load(std::string_view input) {
+    Parser parser(input);
+    return json::BuildDocument([&parser](json::Handler& builder) {
+        parser.ParseValue(builder);
+    });
+}
+
+void Print(const json::Document& doc, std::ostream& output) {
+    Writer writer(output);
+    writer.Value(doc.GetRoot());
+}
+
+}  // namespace cbor
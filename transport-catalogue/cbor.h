@@ -0,0 +1,76 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Двоичное представление той же модели данных в формате CBOR (RFC 8949).
+// Кодирование и разбор работают через json::Handler, поэтому подходят и для дерева json::Node,
+// и для потокового вывода ответов
+namespace cbor {
+
+// Выводит CBOR по событиям Handler. Словари и массивы кодируются с неопределённой длиной,
+// поэтому число элементов заранее знать не нужно
+class Writer final : public json::Handler {
+public:
+    explicit Writer(std::ostream& output);
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    ~Writer() override;
+
+    void Null() override;
+    void Bool(bool value) override;
+    void Int(int value) override;
+    void Double(double value) override;
+    void String(std::string_view value) override;
+    void StartDict() override;
+    void Key(std::string_view key) override;
+    void EndDict() override;
+    void StartArray() override;
+    void EndArray() override;
+
+    void Value(const json::Node& node);
+    void Flush();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    std::ostream& output_;
+    std::string buffer_;
+
+    void AppendHead(uint8_t major_type, uint64_t argument);
+    void AppendIndefinite(uint8_t major_type);
+    void AppendBigEndian(uint64_t value, int bytes);
+    void AfterValue();
+};
+
+// Разбирает CBOR из непрерывного диапазона и сообщает обработчику о каждом значении.
+// Строки байтов не поддерживаются, теги пропускаются
+class Parser {
+public:
+    explicit Parser(std::string_view input);
+
+    void ParseValue(json::Handler& handler);
+
+private:
+    const char* pos_;
+    const char* end_;
+    std::string scratch_;
+
+    uint8_t Get();
+    uint64_t ReadArgument(uint8_t additional);
+    std::string_view ReadText(uint8_t additional);
+    double ReadFloat(uint8_t additional);
+    void ParseDict(uint8_t additional, json::Handler& handler);
+    void ParseArray(uint8_t additional, json::Handler& handler);
+    bool IsBreak();
+};
+
+json::Document Load(std::string_view input);
+
+void Print(const json::Document& doc, std::ostream& output);
+
+}  // namespace cbor
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace concurrency {
+
+// Ограниченная очередь без блокировок для нескольких писателей и нескольких читателей (схема Д. Вьюкова).
+// Каждая ячейка хранит номер хода, по которому писатели и читатели узнают, свободна ли она.
+// Push и Pop недолго ждут места или элемента, уступая процессор, а затем засыпают на условной переменной.
+// Будят их только при наличии спящих, поэтому пока очередь не пуста и не полна, блокировки не берутся
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(RoundUpToPowerOfTwo(capacity))
+        , mask_(capacity_ - 1)
+        , cells_(std::make_unique<Cell[]>(capacity_)) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // При успехе значение перемещается в очередь
+    bool TryPush(T& value) {
+        if (!Enqueue(value)) {
+            return false;
+        }
+        Wake(pop_waiters_, not_empty_);
+        return true;
+    }
+
+    bool TryPop(T& value) {
+        if (!Dequeue(value)) {
+            return false;
+        }
+        Wake(push_waiters_, not_full_);
+        return true;
+    }
+
+    void Push(T value) {
+        Wait(push_waiters_, not_full_, [this, &value] {
+            return Enqueue(value);
+        });
+        Wake(pop_waiters_, not_empty_);
+    }
+
+    T Pop() {
+        T value;
+        Wait(pop_waiters_, not_empty_, [this, &value] {
+            return Dequeue(value);
+        });
+        Wake(push_waiters_, not_full_);
+        return value;
+    }
+
+private:
+    // Счётчики писателей и читателей лежат в разных кэш-линиях, чтобы не мешать друг другу
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    // Сколько раз попробовать, уступая процессор, прежде чем заснуть
+    static constexpr int SPIN_ATTEMPTS = 16;
+
+    struct Cell {
+        std::atomic_size_t sequence;
+        T value;
+    };
+
+    bool Enqueue(T& value) {
+        size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[position & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Dequeue(T& value) {
+        size_t position = dequeue_position_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[position & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+            if (difference == 0) {
+                if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeue_position_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(position + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // Спящий поток сначала увеличивает счётчик, а затем повторяет попытку под мьютексом; будящий
+    // сначала завершает операцию, а затем читает счётчик. Барьеры между записью и чтением гарантируют,
+    // что хотя бы один из них увидит действие другого, поэтому пробуждение не теряется
+    template <typename Attempt>
+    void Wait(std::atomic_size_t& waiters, std::condition_variable& condition, Attempt attempt) {
+        for (int i = 0; i < SPIN_ATTEMPTS; ++i) {
+            if (attempt()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock lock(wait_mutex_);
+            condition.wait(lock, attempt);
+        }
+        waiters.fetch_sub(1);
+    }
+
+    void Wake(std::atomic_size_t& waiters, std::condition_variable& condition) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard lock(wait_mutex_);
+            condition.notify_one();
+        }
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t enqueue_position_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t dequeue_position_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t push_waiters_ = 0;
+    std::atomic_size_t pop_waiters_ = 0;
+    std::mutex wait_mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+}  // namespace concurrency
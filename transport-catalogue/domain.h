@@ -10,6 +10,7 @@ namespace transport {
 struct Stop {
     std::string name;
     geo::Coordinates coordinates;
+    size_t id = 0; // порядковый номер в каталоге, назначается в AddStop
 };
 
 struct Bus {
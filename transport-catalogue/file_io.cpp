@@ -0,0 +1,125 @@
+#include "file_io.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+namespace file_io {
+
+MappedFile::MappedFile(const std::string& path)
+    : fd_(open(path.c_str(), O_RDONLY)) {
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to open "s + path);
+    }
+
+    struct stat info{};
+    if (fstat(fd_, &info) < 0) {
+        const int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), "Failed to stat "s + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    // пустой файл отобразить нельзя, он остаётся пустым диапазоном
+    if (size_ == 0) {
+        return;
+    }
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (data_ == MAP_FAILED) {
+        const int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), "Failed to map "s + path);
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+    close(fd_);
+}
+
+std::string_view MappedFile::GetData() const {
+    return {static_cast<const char*>(data_), size_};
+}
+
+FileOutputBuffer::FileOutputBuffer(const std::string& path)
+    : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) {
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to open "s + path);
+    }
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+FileOutputBuffer::~FileOutputBuffer() {
+    FlushBuffer();
+    close(fd_);
+}
+
+FileOutputBuffer::int_type FileOutputBuffer::overflow(int_type ch) {
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return FlushBuffer() ? traits_type::not_eof(ch) : traits_type::eof();
+    }
+    buffer_.push_back(traits_type::to_char_type(ch));
+    if (buffer_.size() >= BUFFER_SIZE && !FlushBuffer()) {
+        return traits_type::eof();
+    }
+    return ch;
+}
+
+// Блоки не меньше буфера пишутся напрямую, минуя копирование
+std::streamsize FileOutputBuffer::xsputn(const char* data, std::streamsize count) {
+    const size_t size = static_cast<size_t>(count);
+    if (buffer_.size() + size < BUFFER_SIZE) {
+        buffer_.append(data, size);
+        return count;
+    }
+    if (!FlushBuffer()) {
+        return 0;
+    }
+    if (size >= BUFFER_SIZE) {
+        return WriteAll(data, size) ? count : 0;
+    }
+    buffer_.append(data, size);
+    return count;
+}
+
+int FileOutputBuffer::sync() {
+    return FlushBuffer() ? 0 : -1;
+}
+
+bool FileOutputBuffer::FlushBuffer() {
+    const bool written = WriteAll(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    return written;
+}
+
+bool FileOutputBuffer::WriteAll(const char* data, size_t count) {
+    while (count > 0) {
+        const ssize_t written = write(fd_, data, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        count -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+OutputFile::OutputFile(const std::string& path)
+    : std::ostream(nullptr)
+    , buffer_(path) {
+    rdbuf(&buffer_);
+}
+
+}  // namespace file_io
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace file_io {
+
+// Файл, отображённый в память только для чтения. Содержимое доступно одним непрерывным диапазоном
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view GetData() const;
+
+private:
+    int fd_ = -1;
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Буфер вывода в файловый дескриптор: данные уходят в write(2) крупными блоками
+class FileOutputBuffer final : public std::streambuf {
+public:
+    explicit FileOutputBuffer(const std::string& path);
+    ~FileOutputBuffer() override;
+
+    FileOutputBuffer(const FileOutputBuffer&) = delete;
+    FileOutputBuffer& operator=(const FileOutputBuffer&) = delete;
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+    int sync() override;
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    int fd_ = -1;
+    std::string buffer_;
+
+    bool FlushBuffer();
+    bool WriteAll(const char* data, size_t count);
+};
+
+class OutputFile final : public std::ostream {
+public:
+    explicit OutputFile(const std::string& path);
+
+private:
+    FileOutputBuffer buffer_;
+};
+
+}  // namespace file_io
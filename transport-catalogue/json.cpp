@@ -1,6 +1,18 @@
 #include "json.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <sstream>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace json {
 
@@ -8,229 +20,1071 @@ using namespace std::literals;
 
 namespace {
 
-namespace detail {
+// Собирает дерево Node из событий разбора, выделяя строки и контейнеры из арены
+class TreeBuilder final : public Handler {
+public:
+    explicit TreeBuilder(std::pmr::memory_resource* arena)
+        : arena_(arena) {
+    }
 
-void Trim(std::string& string) {
-    const auto start = string.find_first_not_of(' ');
-    string.erase(0, start);
-    string.erase(string.find_last_not_of(' ') + 1, string.find_last_of(' '));
-}
+    Node Extract() {
+        return std::move(root_);
+    }
+
+    void Null() override {
+        Add(nullptr);
+    }
 
-} // namespace json::detail
+    void Bool(bool value) override {
+        Add(value);
+    }
+
+    void Int(int value) override {
+        Add(value);
+    }
 
-Node LoadNode(std::istream& input);
+    void Double(double value) override {
+        Add(value);
+    }
 
-Node LoadBool(std::istream& input) {
-    std::string true_or_false;
-    char c;
-    for (; input >> c && c != ',' &&  c != ']' &&  c != '}' &&  c != ':';) {
-        true_or_false.push_back(c);
+    void String(std::string_view value) override {
+        Add(std::pmr::string(value, arena_));
     }
-    input.putback(c);
 
-    detail::Trim(true_or_false);
-    if (true_or_false == "true"s) {
-        return Node{true};
+    void StartDict() override {
+        nodes_stack_.push_back(&Add(Dict(arena_)));
     }
-    if (true_or_false == "false"s) {
-        return Node{false};
+
+    void Key(std::string_view key) override {
+        key_ = key;
     }
-    throw ParsingError("Null parsing error."s);
-}
 
-Node LoadNull(std::istream& input) {
-    std::string null;
-    
-    for (char c; input >> c && c != ',' && c != ']' && c != '}' && c != ':';) {
-        null.push_back(c);
+    void EndDict() override {
+        nodes_stack_.pop_back();
     }
-    
-    detail::Trim(null);
-    if (null != "null"s) {
-        throw ParsingError("Null parsing error."s);
+
+    void StartArray() override {
+        nodes_stack_.push_back(&Add(Array(arena_)));
+    }
+
+    void EndArray() override {
+        nodes_stack_.pop_back();
+    }
+
+private:
+    std::pmr::memory_resource* arena_;
+    Node root_;
+    std::vector<Node*> nodes_stack_;
+    std::string key_;
+
+    template <typename T>
+    Node& Add(T&& value) {
+        if (nodes_stack_.empty()) {
+            root_ = Node(std::forward<T>(value));
+            return root_;
+        }
+        if (nodes_stack_.back()->IsArray()) {
+            return std::get<Array>(nodes_stack_.back()->GetValue()).emplace_back(std::forward<T>(value));
+        }
+        auto [it, inserted] = std::get<Dict>(nodes_stack_.back()->GetValue())
+                                  .emplace(key_, std::forward<T>(value));
+        if (!inserted) {
+            throw ParsingError("Value is already exist."s);
+        }
+        return it->second;
     }
-    return Node{nullptr};
+};
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+bool IsDigit(int c) {
+    return c >= '0' && c <= '9';
 }
 
-Node LoadArray(std::istream& input) {
-    Array result;
-    char c;
-    for (; input >> c && c != ']';) {
-        if (c != ',') {
-            input.putback(c);
+bool IsNumberChar(char c) {
+    return IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// Поиск по входу ведётся блоками: для каждого блока одной векторной операцией строится битовая
+// маска символов нужного класса, а первый такой символ находится по младшему установленному биту
+constexpr size_t BLOCK_SIZE = 32;
+
+template <char... Chars>
+uint32_t MatchMask(const char* block) {
+#if defined(__AVX2__)
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i matches = _mm256_setzero_si256();
+    ((matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(Chars)))), ...);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+#elif defined(__SSE2__)
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+    __m128i low_matches = _mm_setzero_si128();
+    __m128i high_matches = _mm_setzero_si128();
+    ((low_matches = _mm_or_si128(low_matches, _mm_cmpeq_epi8(low, _mm_set1_epi8(Chars)))), ...);
+    ((high_matches = _mm_or_si128(high_matches, _mm_cmpeq_epi8(high, _mm_set1_epi8(Chars)))), ...);
+    return static_cast<uint32_t>(_mm_movemask_epi8(low_matches))
+        | (static_cast<uint32_t>(_mm_movemask_epi8(high_matches)) << 16);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        if (((block[i] == Chars) || ...)) {
+            mask |= uint32_t{1} << i;
         }
-        result.push_back(LoadNode(input));
     }
+    return mask;
+#endif
+}
 
-    if (c != ']') {
-        throw ParsingError("Failed to read array from stream."s);
+int LowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++bit;
     }
+    return bit;
+#endif
+}
 
-    return Node(std::move(result));
+// Первый из символов Chars в диапазоне или end
+template <char... Chars>
+const char* FindAny(const char* begin, const char* end) {
+    for (; end - begin >= static_cast<std::ptrdiff_t>(BLOCK_SIZE); begin += BLOCK_SIZE) {
+        if (const uint32_t mask = MatchMask<Chars...>(begin)) {
+            return begin + LowestBit(mask);
+        }
+    }
+    while (begin != end && ((*begin != Chars) && ...)) {
+        ++begin;
+    }
+    return begin;
 }
 
-Node LoadNumber(std::istream& input) {
-    using namespace std::literals;
+// Первый символ, на котором заканчивается простой участок строки: кавычка, '\\' или перевод строки
+const char* FindStringSpecial(const char* begin, const char* end) {
+    return FindAny<'"', '\\', '\n', '\r'>(begin, end);
+}
 
-    std::string parsed_num;
+// Позиция за закрывающей скобкой контейнера, начинающегося в begin. Содержимое не проверяется,
+// учитываются только вложенность скобок и границы строк
+const char* SkipContainer(const char* begin, const char* end) {
+    int depth = 0;
+    for (const char* pos = begin;; ++pos) {
+        pos = FindAny<'"', '{', '}', '[', ']'>(pos, end);
+        if (pos == end) {
+            throw ParsingError("Unexpected end of container."s);
+        }
+        if (*pos == '"') {
+            for (++pos;; pos += 2) {
+                pos = FindAny<'"', '\\'>(pos, end);
+                if (pos == end || (*pos == '\\' && pos + 1 == end)) {
+                    throw ParsingError("Unexpected end of string."s);
+                }
+                if (*pos == '"') {
+                    break;
+                }
+            }
+        } else if (*pos == '{' || *pos == '[') {
+            ++depth;
+        } else if (--depth == 0) {
+            return pos + 1;
+        }
+    }
+}
 
-    auto read_char = [&parsed_num, &input] {
-        parsed_num += static_cast<char>(input.get());
-        if (!input) {
-            throw ParsingError("Failed to read number from stream"s);
+// Разбирает значение, ничего не сообщая наружу
+class SkipHandler final : public Handler {
+public:
+    void Null() override {
+    }
+    void Bool(bool) override {
+    }
+    void Int(int) override {
+    }
+    void Double(double) override {
+    }
+    void String(std::string_view) override {
+    }
+    void StartDict() override {
+    }
+    void Key(std::string_view) override {
+    }
+    void EndDict() override {
+    }
+    void StartArray() override {
+    }
+    void EndArray() override {
+    }
+};
+
+const char* FindNonSpace(const char* begin, const char* end) {
+    for (; end - begin >= static_cast<std::ptrdiff_t>(BLOCK_SIZE); begin += BLOCK_SIZE) {
+        if (const uint32_t mask = ~MatchMask<' ', '\n', '\t', '\r'>(begin)) {
+            return begin + LowestBit(mask);
         }
+    }
+    while (begin != end && IsSpace(*begin)) {
+        ++begin;
+    }
+    return begin;
+}
+
+// Проверяет запись числа и возвращает позицию за её концом
+const char* ScanNumber(const char* begin, const char* end, bool& is_int) {
+    auto peek = [&begin, end] {
+        return begin != end ? *begin : '\0';
     };
 
-    auto read_digits = [&input, read_char] {
-        if (!std::isdigit(input.peek())) {
+    auto read_digits = [&begin, end, peek] {
+        if (!IsDigit(peek())) {
             throw ParsingError("A digit is expected"s);
         }
-        while (std::isdigit(input.peek())) {
-            read_char();
+        while (IsDigit(peek())) {
+            ++begin;
         }
     };
 
-    if (input.peek() == '-') {
-        read_char();
+    if (peek() == '-') {
+        ++begin;
     }
 
-    if (input.peek() == '0') {
-        read_char();
+    if (peek() == '0') {
+        ++begin;
     } else {
         read_digits();
     }
 
-    bool is_int = true;
-    if (input.peek() == '.') {
+    is_int = true;
+    if (peek() == '.') {
         is_int = false;
-        read_char();
+        ++begin;
         read_digits();
     }
 
-    if (char ch = input.peek(); ch == 'e' || ch == 'E') {
-        read_char();
-        if (ch = input.peek(); ch == '+' || ch == '-') {
-            read_char();
+    if (char ch = peek(); ch == 'e' || ch == 'E') {
+        ++begin;
+        if (ch = peek(); ch == '+' || ch == '-') {
+            ++begin;
         }
         read_digits();
         is_int = false;
     }
+    return begin;
+}
 
-    try {
-        if (is_int) {
-            try {
-                int num = std::stoi(parsed_num);
-                return Node{num};
-            } catch (...) {
-            }
+// Символ, который обозначает escape-последовательность с символом escaped_char после '\\'
+char UnescapeChar(char escaped_char) {
+    switch (escaped_char) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case '"':
+        case '\\':
+        case '/':
+            return escaped_char;
+        default:
+            throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+    }
+}
+
+// Передаёт проверенную ScanNumber запись числа как int, если она целая и помещается в int, иначе как double
+template <typename Target>
+void ReportNumber(const char* first, const char* last, bool is_int, Target& target) {
+    if (is_int) {
+        int num = 0;
+        if (auto [ptr, ec] = std::from_chars(first, last, num); ec == std::errc{}) {
+            target.Int(num);
+            return;
         }
-        double num = std::stod(parsed_num);
-        return Node{num};
-    } catch (...) {
-        throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
     }
+    double num = 0.;
+    if (auto [ptr, ec] = std::from_chars(first, last, num); ec != std::errc{}) {
+        throw ParsingError("Failed to convert "s + std::string(first, last) + " to number"s);
+    }
+    target.Double(num);
+}
+
+}  // namespace
+
+Parser::Parser(std::istream& input)
+    : input_(&input) {
+}
+
+Parser::Parser(std::string_view input)
+    : pos_(input.data())
+    , end_(input.data() + input.size()) {
+}
+
+bool Parser::Fill() {
+    if (input_ == nullptr) {
+        return false;
+    }
+    chunk_.resize(CHUNK_SIZE);
+    input_->read(chunk_.data(), CHUNK_SIZE);
+    chunk_.resize(static_cast<size_t>(input_->gcount()));
+    pos_ = chunk_.data();
+    end_ = pos_ + chunk_.size();
+    return pos_ != end_;
 }
 
-Node LoadString(std::istream& input) {
-    auto it = std::istreambuf_iterator<char>(input);
-    auto end = std::istreambuf_iterator<char>();
-    std::string s;
+int Parser::Peek() {
+    if (pos_ == end_ && !Fill()) {
+        return std::char_traits<char>::eof();
+    }
+    return static_cast<unsigned char>(*pos_);
+}
+
+char Parser::Get() {
+    if (pos_ == end_ && !Fill()) {
+        throw ParsingError("Unexpected end of input."s);
+    }
+    return *pos_++;
+}
+
+void Parser::Expect(char expected) {
+    SkipSpaces();
+    if (Get() != expected) {
+        throw ParsingError("Expected '"s + expected + "'."s);
+    }
+}
+
+void Parser::SkipSpaces() {
     while (true) {
-        if (it == end) {
-            throw ParsingError("String parsing error");
+        pos_ = FindNonSpace(pos_, end_);
+        if (pos_ != end_ || !Fill()) {
+            return;
+        }
+    }
+}
+
+void Parser::StartDict() {
+    Expect('{');
+    has_items_.push_back(false);
+}
+
+bool Parser::NextKey(std::string& key) {
+    if (!NextElement('}')) {
+        return false;
+    }
+    SkipSpaces();
+    if (Get() != '"') {
+        throw ParsingError("Dict key must be a string."s);
+    }
+    key = ParseString();
+    Expect(':');
+    return true;
+}
+
+void Parser::StartArray() {
+    Expect('[');
+    has_items_.push_back(false);
+}
+
+bool Parser::NextItem() {
+    return NextElement(']');
+}
+
+// Пропускает разделитель перед очередным элементом контейнера
+// или закрывающую скобку, если элементов больше нет
+bool Parser::NextElement(char close) {
+    if (has_items_.empty()) {
+        throw ParsingError("No container is open."s);
+    }
+    SkipSpaces();
+    if (Peek() == close) {
+        ++pos_;
+        has_items_.pop_back();
+        return false;
+    }
+    if (has_items_.back()) {
+        Expect(',');
+    }
+    has_items_.back() = true;
+    return true;
+}
+
+std::string_view Parser::SkipValue() {
+    if (input_ != nullptr) {
+        throw ParsingError("Raw values are available only for contiguous input."s);
+    }
+    SkipSpaces();
+    const char* begin = pos_;
+    if (pos_ != end_ && (*pos_ == '{' || *pos_ == '[')) {
+        pos_ = SkipContainer(pos_, end_);
+    } else {
+        SkipHandler skip;
+        ParseValue(skip);
+    }
+    return {begin, static_cast<size_t>(pos_ - begin)};
+}
+
+void Parser::ParseValue(Handler& handler) {
+    SkipSpaces();
+    switch (Peek()) {
+        case '{':
+            ParseDict(handler);
+            break;
+        case '[':
+            ParseArray(handler);
+            break;
+        case '"':
+            ++pos_;
+            handler.String(ParseString());
+            break;
+        case 'n':
+            ParseLiteral("null"sv);
+            handler.Null();
+            break;
+        case 't':
+            ParseLiteral("true"sv);
+            handler.Bool(true);
+            break;
+        case 'f':
+            ParseLiteral("false"sv);
+            handler.Bool(false);
+            break;
+        case ']':
+        case '}':
+            throw ParsingError("Array or Map has been closed before opening."s);
+        default:
+            ParseNumber(handler);
+            break;
+    }
+}
+
+void Parser::ParseDict(Handler& handler) {
+    StartDict();
+    handler.StartDict();
+    std::string key;
+    while (NextKey(key)) {
+        handler.Key(key);
+        ParseValue(handler);
+    }
+    handler.EndDict();
+}
+
+void Parser::ParseArray(Handler& handler) {
+    StartArray();
+    handler.StartArray();
+    while (NextItem()) {
+        ParseValue(handler);
+    }
+    handler.EndArray();
+}
+
+void Parser::ParseLiteral(std::string_view literal) {
+    for (char expected : literal) {
+        if (Peek() != static_cast<unsigned char>(expected)) {
+            throw ParsingError("Failed to parse "s + std::string(literal) + "."s);
+        }
+        ++pos_;
+    }
+}
+
+// Число, целиком лежащее в текущей порции входа, преобразуется на месте;
+// число на границе порций сначала собирается в scratch_
+void Parser::ParseNumber(Handler& handler) {
+    const char* first = pos_;
+    const char* last = std::find_if_not(pos_, end_, IsNumberChar);
+    if (last == end_) {
+        scratch_.assign(pos_, end_);
+        pos_ = end_;
+        while (Peek() != std::char_traits<char>::eof() && IsNumberChar(static_cast<char>(Peek()))) {
+            scratch_.push_back(*pos_++);
         }
-        const char ch = *it;
+        first = scratch_.data();
+        last = first + scratch_.size();
+    }
+
+    bool is_int = true;
+    const char* number_end = ScanNumber(first, last, is_int);
+    if (first != scratch_.data()) {
+        pos_ = number_end;
+    } else if (number_end != last) {
+        throw ParsingError("Failed to convert "s + scratch_ + " to number"s);
+    }
+
+    ReportNumber(first, number_end, is_int, handler);
+}
+
+// Разбирает строку после открывающей кавычки. Если строка без escape-последовательностей
+// целиком лежит в текущей порции входа, возвращается ссылка прямо на неё
+std::string_view Parser::ParseString() {
+    const char* run = pos_;
+    pos_ = FindStringSpecial(pos_, end_);
+    if (pos_ != end_ && *pos_ == '"') {
+        return {run, static_cast<size_t>(pos_++ - run)};
+    }
+
+    scratch_.assign(run, pos_);
+    while (true) {
+        const char ch = Get();
         if (ch == '"') {
-            ++it;
             break;
         } else if (ch == '\\') {
-            ++it;
-            if (it == end) {
-                throw ParsingError("String parsing error");
-            }
-            const char escaped_char = *(it);
-            switch (escaped_char) {
-                case 'n':
-                    s.push_back('\n');
-                    break;
-                case 't':
-                    s.push_back('\t');
-                    break;
-                case 'r':
-                    s.push_back('\r');
-                    break;
-                case '"':
-                    s.push_back('"');
-                    break;
-                case '\\':
-                    s.push_back('\\');
-                    break;
-                default:
-                    throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
-            }
+            scratch_.push_back(UnescapeChar(Get()));
         } else if (ch == '\n' || ch == '\r') {
             throw ParsingError("Unexpected end of line"s);
         } else {
-            s.push_back(ch);
+            scratch_.push_back(ch);
         }
-        ++it;
+        run = pos_;
+        pos_ = FindStringSpecial(pos_, end_);
+        scratch_.append(run, pos_);
     }
+    return scratch_;
+}
+
+// ---------- Структурный индекс ------------------
 
-    return {s};
+namespace {
+
+constexpr size_t INDEX_BLOCK_SIZE = 64;
+
+// Маски символов одного блока: i-й бит соответствует i-му байту
+struct BlockMasks {
+    uint64_t quotes = 0;
+    uint64_t backslashes = 0;
+    uint64_t structurals = 0;
+    uint64_t spaces = 0;
+};
+
+template <char... Chars>
+uint64_t MatchBlockMask(const char* block) {
+    return MatchMask<Chars...>(block) | (static_cast<uint64_t>(MatchMask<Chars...>(block + BLOCK_SIZE)) << BLOCK_SIZE);
 }
 
-Node LoadDict(std::istream& input) {
-    Dict result;
-    std::string key;
-    for (char c; input >> c && c != '}';) {
-        if (c == '"') {
-            key = LoadString(input).AsString();
-        } else if (c == ':') {
-            if (result.find(key) != result.end()) {
-                throw ParsingError("Value is already exist."s);
-            }
-            result.emplace(std::move(key), LoadNode(input));
-        } else if (c == ',') {
-            continue;
+BlockMasks ClassifyBlock(const char* block) {
+    return {MatchBlockMask<'"'>(block),
+            MatchBlockMask<'\\'>(block),
+            MatchBlockMask<'{', '}', '[', ']', ':', ','>(block),
+            MatchBlockMask<' ', '\n', '\t', '\r'>(block)};
+}
+
+// Сборка без -mavx2 всё равно использует AVX2, если его поддерживает процессор: эти функции
+// компилируются для AVX2 отдельно, а вариант выбирается один раз при первом разборе
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(__AVX2__)
+#define JSON_AVX2_DISPATCH 1
+
+template <char... Chars>
+__attribute__((target("avx2"))) uint64_t MatchBlockMaskAvx2(const char* block) {
+    const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    __m256i low_matches = _mm256_setzero_si256();
+    __m256i high_matches = _mm256_setzero_si256();
+    ((low_matches = _mm256_or_si256(low_matches, _mm256_cmpeq_epi8(low, _mm256_set1_epi8(Chars)))), ...);
+    ((high_matches = _mm256_or_si256(high_matches, _mm256_cmpeq_epi8(high, _mm256_set1_epi8(Chars)))), ...);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(low_matches))
+        | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(high_matches))) << 32);
+}
+
+__attribute__((target("avx2"))) BlockMasks ClassifyBlockAvx2(const char* block) {
+    return {MatchBlockMaskAvx2<'"'>(block),
+            MatchBlockMaskAvx2<'\\'>(block),
+            MatchBlockMaskAvx2<'{', '}', '[', ']', ':', ','>(block),
+            MatchBlockMaskAvx2<' ', '\n', '\t', '\r'>(block)};
+}
+#endif
+
+// Перенос сложения 64-битных чисел
+bool AddOverflow(uint64_t lhs, uint64_t rhs, uint64_t& sum) {
+    sum = lhs + rhs;
+    return sum < lhs;
+}
+
+// Символы, экранированные обратной косой чертой: второй символ каждой пары "\x".
+// Нечётная серия черт экранирует символ после себя; escaped_carry переносит это состояние в следующий блок
+uint64_t FindEscaped(uint64_t backslashes, uint64_t& escaped_carry) {
+    constexpr uint64_t EVEN_BITS = 0x5555'5555'5555'5555ULL;
+    backslashes &= ~escaped_carry;
+    const uint64_t follows_escape = backslashes << 1 | escaped_carry;
+    const uint64_t odd_sequence_starts = backslashes & ~EVEN_BITS & ~follows_escape;
+    uint64_t sequences_starting_on_even_bits = 0;
+    escaped_carry = AddOverflow(odd_sequence_starts, backslashes, sequences_starting_on_even_bits) ? 1 : 0;
+    const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+    return (EVEN_BITS ^ invert_mask) & follows_escape;
+}
+
+// Бит i результата — чётность числа установленных битов в [0, i]: между кавычками она равна единице
+uint64_t PrefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// Состояние, переходящее из блока в блок
+struct IndexCarry {
+    uint64_t escaped = 0;
+    uint64_t in_string = 0; // все единицы, если предыдущий блок закончился внутри строки
+    uint64_t scalar = 0;    // 1, если предыдущий блок закончился символом скаляра
+};
+
+// Дописывает позиции блока в out и возвращает конец записанного; в out должно быть место для INDEX_BLOCK_SIZE позиций
+size_t* IndexBlock(const BlockMasks& masks, size_t offset, IndexCarry& carry, size_t* out) {
+    const uint64_t escaped = FindEscaped(masks.backslashes, carry.escaped);
+    const uint64_t quotes = masks.quotes & ~escaped;
+    // единицы от открывающей кавычки до символа перед закрывающей
+    const uint64_t in_string = PrefixXor(quotes) ^ carry.in_string;
+    carry.in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+    const uint64_t scalar = ~(masks.structurals | masks.spaces | masks.quotes) & ~in_string;
+    const uint64_t scalar_starts = scalar & ~(scalar << 1 | carry.scalar);
+    carry.scalar = scalar >> 63;
+
+    for (uint64_t bits = (masks.structurals & ~in_string) | (quotes & in_string) | scalar_starts; bits != 0;
+         bits &= bits - 1) {
+#if defined(__GNUC__)
+        *out++ = offset + static_cast<size_t>(__builtin_ctzll(bits));
+#else
+        size_t bit = 0;
+        while (((bits >> bit) & 1) == 0) {
+            ++bit;
         }
+        *out++ = offset + bit;
+#endif
     }
+    return out;
+}
 
-    if (!input) {
-        throw ParsingError("Failed to read map from stream."s);
+// Индексирует блоки [offset, end) и возвращает конец записанных позиций; в out должно быть место
+// для всех позиций диапазона. Неполный последний блок дополняется пробелами, которые не попадают в индекс
+template <BlockMasks (*Classify)(const char*)>
+size_t* IndexBlocks(std::string_view input, size_t offset, size_t end, IndexCarry& carry, size_t* out) {
+    for (; end - offset >= INDEX_BLOCK_SIZE; offset += INDEX_BLOCK_SIZE) {
+        out = IndexBlock(Classify(input.data() + offset), offset, carry, out);
+    }
+    if (offset != end) {
+        char block[INDEX_BLOCK_SIZE];
+        std::fill(std::begin(block), std::end(block), ' ');
+        std::copy(input.begin() + offset, input.begin() + end, block);
+        out = IndexBlock(Classify(block), offset, carry, out);
     }
+    return out;
+}
 
-    return Node(std::move(result));
+#ifdef JSON_AVX2_DISPATCH
+__attribute__((target("avx2"))) size_t* IndexBlocksAvx2(std::string_view input, size_t offset, size_t end,
+                                                        IndexCarry& carry, size_t* out) {
+    return IndexBlocks<ClassifyBlockAvx2>(input, offset, end, carry, out);
 }
+#endif
+
+// Строит индекс порциями фиксированного размера, чтобы позиции не занимали память
+// пропорционально входу и читались, пока ещё лежат в кэше
+class StructuralIndexer {
+public:
+    explicit StructuralIndexer(std::string_view input)
+        : input_(input)
+        , positions_(WINDOW_SIZE) {
+#ifdef JSON_AVX2_DISPATCH
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2) {
+            index_blocks_ = IndexBlocksAvx2;
+        }
+#endif
+    }
 
-Node LoadNode(std::istream& input) {
-    char c;
-    input.get(c);
-    while (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
-        input.get(c);
+    // Позиции следующей непустой порции; пустой диапазон означает конец входа
+    std::pair<const size_t*, const size_t*> Next() {
+        while (offset_ != input_.size()) {
+            const size_t end = std::min(offset_ + WINDOW_SIZE, input_.size());
+            const size_t* last = index_blocks_(input_, offset_, end, carry_, positions_.data());
+            offset_ = end;
+            if (last != positions_.data()) {
+                return {positions_.data(), last};
+            }
+        }
+        if (carry_.in_string != 0) {
+            throw ParsingError("Unexpected end of string."s);
+        }
+        return {nullptr, nullptr};
     }
 
-    if (c == ']' || c == '}') {
-        throw ParsingError("Array or Map has been closed before opening."s);
-    } else if (c == '[') {
-        return LoadArray(input);
-    } else if (c == '{') {
-        return LoadDict(input);
-    } else if (c == '"') {
-        return LoadString(input);
-    } else if (c == 'n') {
-        input.putback(c);
-        return LoadNull(input);
-    } else if (c == 't' || c == 'f') {
-        input.putback(c);
-        return LoadBool(input);
-    } else {
-        input.putback(c);
-        return LoadNumber(input);
+private:
+    static constexpr size_t WINDOW_SIZE = 256 * INDEX_BLOCK_SIZE;
+
+    std::string_view input_;
+    std::vector<size_t> positions_;
+    IndexCarry carry_;
+    size_t offset_ = 0;
+    size_t* (*index_blocks_)(std::string_view, size_t, size_t, IndexCarry&, size_t*) = IndexBlocks<ClassifyBlock>;
+};
+
+bool IsAtomEnd(std::string_view input, size_t pos) {
+    if (pos == input.size()) {
+        return true;
     }
+    const char c = input[pos];
+    return IsSpace(c) || c == ',' || c == ':' || c == '}' || c == ']' || c == '{' || c == '[' || c == '"';
 }
 
 }  // namespace
 
+std::vector<size_t> BuildStructuralIndex(std::string_view input) {
+    std::vector<size_t> positions;
+    positions.reserve(input.size() / 8);
+    StructuralIndexer indexer(input);
+    for (auto [first, last] = indexer.Next(); first != last; std::tie(first, last) = indexer.Next()) {
+        positions.insert(positions.end(), first, last);
+    }
+    return positions;
+}
+
+// Второй этап: проходит по позициям индекса и записывает значения в ленту. Разделители
+// и скобки проверяются по индексу, поэтому пробелы между ними не просматриваются
+class TapeBuilder {
+public:
+    TapeBuilder(std::string_view input, Tape& tape)
+        : input_(input)
+        , indexer_(input)
+        , tape_(tape) {
+    }
+
+    void Build() {
+        ParseValue();
+        if (HasPosition()) {
+            throw ParsingError("Unexpected data after the document."s);
+        }
+    }
+
+    void Int(int value) {
+        Add(Tape::Type::INT, static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+
+    void Double(double value) {
+        uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Add(Tape::Type::DOUBLE, bits);
+    }
+
+private:
+    std::string_view input_;
+    StructuralIndexer indexer_;
+    Tape& tape_;
+    const size_t* next_ = nullptr;
+    const size_t* last_ = nullptr;
+
+    // Подгружает следующую порцию индекса, когда текущая прочитана
+    bool HasPosition() {
+        if (next_ == last_) {
+            std::tie(next_, last_) = indexer_.Next();
+        }
+        return next_ != last_;
+    }
+
+    size_t NextPosition() {
+        if (!HasPosition()) {
+            throw ParsingError("Unexpected end of input."s);
+        }
+        return *next_++;
+    }
+
+    char PeekChar() {
+        return HasPosition() ? input_[*next_] : '\0';
+    }
+
+    void Expect(char expected) {
+        if (input_[NextPosition()] != expected) {
+            throw ParsingError("Expected '"s + expected + "'."s);
+        }
+    }
+
+    size_t Add(Tape::Type type, uint64_t payload = 0, uint32_t length = 0) {
+        tape_.entries_.push_back({type, length, payload});
+        return tape_.entries_.size() - 1;
+    }
+
+    void ParseValue() {
+        const size_t pos = NextPosition();
+        switch (input_[pos]) {
+            case '{':
+                ParseContainer(Tape::Type::START_DICT, Tape::Type::END_DICT, '}');
+                break;
+            case '[':
+                ParseContainer(Tape::Type::START_ARRAY, Tape::Type::END_ARRAY, ']');
+                break;
+            case '"':
+                ParseString(pos, Tape::Type::STRING);
+                break;
+            case 'n':
+                ParseLiteral(pos, "null"sv, Tape::Type::NUL);
+                break;
+            case 't':
+                ParseLiteral(pos, "true"sv, Tape::Type::TRUE);
+                break;
+            case 'f':
+                ParseLiteral(pos, "false"sv, Tape::Type::FALSE);
+                break;
+            case ']':
+            case '}':
+                throw ParsingError("Array or Map has been closed before opening."s);
+            default:
+                ParseNumber(pos);
+                break;
+        }
+    }
+
+    // В словаре перед каждым значением записывается ключ
+    void ParseContainer(Tape::Type start, Tape::Type end, char close) {
+        const size_t start_index = Add(start);
+        if (PeekChar() == close) {
+            ++next_;
+        } else {
+            while (true) {
+                if (start == Tape::Type::START_DICT) {
+                    const size_t key_pos = NextPosition();
+                    if (input_[key_pos] != '"') {
+                        throw ParsingError("Dict key must be a string."s);
+                    }
+                    ParseString(key_pos, Tape::Type::KEY);
+                    Expect(':');
+                }
+                ParseValue();
+                const char separator = input_[NextPosition()];
+                if (separator == close) {
+                    break;
+                }
+                if (separator != ',') {
+                    throw ParsingError("Expected ','."s);
+                }
+            }
+        }
+        const size_t end_index = Add(end, start_index);
+        tape_.entries_[start_index].payload = end_index;
+    }
+
+    // Закрывающая кавычка в индекс не попадает, поэтому конец строки ищется по входу
+    void ParseString(size_t quote_pos, Tape::Type type) {
+        const char* begin = input_.data() + quote_pos + 1;
+        const char* end = input_.data() + input_.size();
+        const char* pos = FindStringSpecial(begin, end);
+        if (pos != end && *pos == '"') {
+            Add(type, static_cast<uint64_t>(begin - input_.data()), static_cast<uint32_t>(pos - begin));
+            return;
+        }
+
+        std::string& strings = tape_.strings_;
+        const size_t offset = strings.size();
+        strings.append(begin, pos);
+        while (true) {
+            if (pos == end) {
+                throw ParsingError("Unexpected end of string."s);
+            }
+            if (*pos == '"') {
+                break;
+            }
+            if (*pos != '\\') {
+                throw ParsingError("Unexpected end of line"s);
+            }
+            if (++pos == end) {
+                throw ParsingError("Unexpected end of string."s);
+            }
+            strings.push_back(UnescapeChar(*pos++));
+            const char* run = pos;
+            pos = FindStringSpecial(pos, end);
+            strings.append(run, pos);
+        }
+        Add(type, offset | Tape::UNESCAPED_STRING, static_cast<uint32_t>(strings.size() - offset));
+    }
+
+    void ParseLiteral(size_t pos, std::string_view literal, Tape::Type type) {
+        if (input_.substr(pos, literal.size()) != literal || !IsAtomEnd(input_, pos + literal.size())) {
+            throw ParsingError("Failed to parse "s + std::string(literal) + "."s);
+        }
+        Add(type);
+    }
+
+    void ParseNumber(size_t pos) {
+        const char* first = input_.data() + pos;
+        bool is_int = true;
+        const char* last = ScanNumber(first, input_.data() + input_.size(), is_int);
+        if (!IsAtomEnd(input_, static_cast<size_t>(last - input_.data()))) {
+            throw ParsingError("Failed to convert "s + std::string(first, last) + " to number"s);
+        }
+        ReportNumber(first, last, is_int, *this);
+    }
+};
+
+Tape::Tape(std::string_view input)
+    : input_(input) {
+    // примерно одно значение на каждые 16 байт типичного JSON
+    entries_.reserve(input.size() / 16);
+    TapeBuilder(input, *this).Build();
+}
+
+size_t Tape::size() const {
+    return entries_.size();
+}
+
+Tape::Type Tape::GetType(size_t index) const {
+    return entries_.at(index).type;
+}
+
+std::string_view Tape::GetString(size_t index) const {
+    const Entry& entry = entries_.at(index);
+    if (entry.type != Type::STRING && entry.type != Type::KEY) {
+        throw std::logic_error("Tape entry is not a string."s);
+    }
+    return GetEntryString(entry);
+}
+
+std::string_view Tape::GetEntryString(const Entry& entry) const {
+    if (entry.payload & UNESCAPED_STRING) {
+        return std::string_view(strings_).substr(entry.payload & ~UNESCAPED_STRING, entry.length);
+    }
+    return input_.substr(entry.payload, entry.length);
+}
+
+size_t Tape::Next(size_t index) const {
+    const Entry& entry = entries_.at(index);
+    if (entry.type == Type::START_DICT || entry.type == Type::START_ARRAY) {
+        return entry.payload + 1;
+    }
+    return index + 1;
+}
+
+size_t Tape::Emit(size_t index, Handler& handler) const {
+    const size_t end = Next(index);
+    for (; index < end; ++index) {
+        const Entry& entry = entries_[index];
+        switch (entry.type) {
+            case Type::NUL:
+                handler.Null();
+                break;
+            case Type::TRUE:
+                handler.Bool(true);
+                break;
+            case Type::FALSE:
+                handler.Bool(false);
+                break;
+            case Type::INT:
+                handler.Int(static_cast<int>(static_cast<int64_t>(entry.payload)));
+                break;
+            case Type::DOUBLE: {
+                double value = 0.;
+                std::memcpy(&value, &entry.payload, sizeof(value));
+                handler.Double(value);
+                break;
+            }
+            case Type::STRING:
+                handler.String(GetEntryString(entry));
+                break;
+            case Type::KEY:
+                handler.Key(GetEntryString(entry));
+                break;
+            case Type::START_DICT:
+                handler.StartDict();
+                break;
+            case Type::END_DICT:
+                handler.EndDict();
+                break;
+            case Type::START_ARRAY:
+                handler.StartArray();
+                break;
+            case Type::END_ARRAY:
+                handler.EndArray();
+                break;
+        }
+    }
+    return end;
+}
+
+Dict::Dict(const allocator_type& allocator)
+    : items_(allocator) {
+}
+
+Dict::iterator Dict::begin() {
+    return items_.begin();
+}
+
+Dict::iterator Dict::end() {
+    return items_.end();
+}
+
+Dict::const_iterator Dict::begin() const {
+    return items_.begin();
+}
+
+Dict::const_iterator Dict::end() const {
+    return items_.end();
+}
+
+size_t Dict::size() const {
+    return items_.size();
+}
+
+bool Dict::empty() const {
+    return items_.empty();
+}
+
+Dict::iterator Dict::find(std::string_view key) {
+    auto it = LowerBound(key);
+    return it != items_.end() && it->first == key ? it : items_.end();
+}
+
+Dict::const_iterator Dict::find(std::string_view key) const {
+    return const_cast<Dict*>(this)->find(key);
+}
+
+size_t Dict::count(std::string_view key) const {
+    return find(key) == end() ? 0 : 1;
+}
+
+Node& Dict::at(std::string_view key) {
+    auto it = find(key);
+    if (it == items_.end()) {
+        throw std::out_of_range("Key "s + std::string(key) + " is not found."s);
+    }
+    return it->second;
+}
+
+const Node& Dict::at(std::string_view key) const {
+    return const_cast<Dict*>(this)->at(key);
+}
+
+Node& Dict::operator[](std::string_view key) {
+    return emplace(key, Node{}).first->second;
+}
+
+// Ключи во входных данных часто идут по порядку, поэтому сначала проверяется вставка в конец
+std::pair<Dict::iterator, bool> Dict::emplace(std::string_view key, Node value) {
+    if (items_.empty() || items_.back().first < key) {
+        items_.emplace_back(key, std::move(value));
+        return {std::prev(items_.end()), true};
+    }
+    auto it = LowerBound(key);
+    if (it->first == key) {
+        return {it, false};
+    }
+    return {items_.emplace(it, key, std::move(value)), true};
+}
+
+bool Dict::operator==(const Dict& other) const {
+    return items_ == other.items_;
+}
+
+bool Dict::operator!=(const Dict& other) const {
+    return !(*this == other);
+}
+
+Dict::iterator Dict::LowerBound(std::string_view key) {
+    return std::lower_bound(items_.begin(), items_.end(), key, [](const value_type& item, std::string_view key) {
+        return item.first < key;
+    });
+}
+
 const Value& Node::GetValue() const {
     return *this;
 }
@@ -265,7 +1119,7 @@ bool Node::IsBool() const {
 }
 
 bool Node::IsString() const {
-    return std::holds_alternative<std::string>(*this);
+    return std::holds_alternative<std::pmr::string>(*this);
 }
 
 bool Node::IsNull() const {
@@ -304,11 +1158,11 @@ double Node::AsDouble() const {
     return std::get<double>(*this);
 }
 
-const std::string& Node::AsString() const {
+const std::pmr::string& Node::AsString() const {
     if (!IsString()) {
         throw std::logic_error("Value has another type."s);
     }
-    return std::get<std::string>(*this);
+    return std::get<std::pmr::string>(*this);
 }
 
 const Array& Node::AsArray() const {
@@ -324,8 +1178,38 @@ const Dict& Node::AsDict() const {
     return std::get<Dict>(*this);
 }
 
-Document::Document(Node root)
-    : root_(std::move(root)) {
+Array& Node::AsArray() {
+    if (!IsArray()) {
+        throw std::logic_error("Value has another type."s);
+    }
+    return std::get<Array>(*this);
+}
+
+Dict& Node::AsDict() {
+    if (!IsDict()) {
+        throw std::logic_error("Value has another type."s);
+    }
+    return std::get<Dict>(*this);
+}
+
+Document::Document(Node root, std::shared_ptr<std::pmr::memory_resource> arena)
+    : arena_(std::move(arena))
+    , root_(std::move(root)) {
+}
+
+Document& Document::operator=(const Document& other) {
+    return *this = Document(other);
+}
+
+// Контейнеры pmr не перенимают аллокатор при присваивании, поэтому узлы другого документа
+// переносятся в пустой корень, а старая арена освобождается только после старых узлов
+Document& Document::operator=(Document&& other) noexcept {
+    if (this != &other) {
+        root_ = Node{};
+        root_ = std::move(other.root_);
+        arena_ = std::move(other.arena_);
+    }
+    return *this;
 }
 
 bool Document::operator==(const Document& other) const {
@@ -340,125 +1224,277 @@ const Node& Document::GetRoot() const {
     return root_;
 }
 
+Node& Document::GetRoot() {
+    return root_;
+}
+
+const std::shared_ptr<std::pmr::memory_resource>& Document::GetArena() const {
+    return arena_;
+}
+
+void Parse(std::istream& input, Handler& handler) {
+    Parser parser(input);
+    parser.ParseValue(handler);
+}
+
 Document Load(std::istream& input) {
-    return Document{LoadNode(input)};
+    Parser parser(input);
+    return Load(parser);
+}
+
+Document Load(std::string_view input) {
+    Parser parser(input);
+    return Load(parser);
+}
+
+Document Load(Parser& parser) {
+    return BuildDocument([&parser](Handler& builder) {
+        parser.ParseValue(builder);
+    });
 }
 
-struct PrintContext {
-    std::ostream& out;
-    int indent_step = 4;
-    int indent = 0;
+Document BuildDocument(const std::function<void(Handler&)>& produce) {
+    auto arena = std::make_shared<std::pmr::monotonic_buffer_resource>();
+    TreeBuilder builder(arena.get());
+    produce(builder);
+    return Document{builder.Extract(), std::move(arena)};
+}
 
-    void PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+void Emit(const Node& node, Handler& handler) {
+    std::visit([&handler](const auto& value) {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            handler.Null();
+        } else if constexpr (std::is_same_v<T, bool>) {
+            handler.Bool(value);
+        } else if constexpr (std::is_same_v<T, int>) {
+            handler.Int(value);
+        } else if constexpr (std::is_same_v<T, double>) {
+            handler.Double(value);
+        } else if constexpr (std::is_same_v<T, std::pmr::string>) {
+            handler.String(value);
+        } else if constexpr (std::is_same_v<T, Array>) {
+            handler.StartArray();
+            for (const Node& item : value) {
+                Emit(item, handler);
+            }
+            handler.EndArray();
+        } else {
+            handler.StartDict();
+            for (const auto& [key, item] : value) {
+                handler.Key(key);
+                Emit(item, handler);
+            }
+            handler.EndDict();
         }
-    }
+    }, node.GetValue());
+}
 
-    // Возвращает новый контекст вывода с увеличенным смещением
-    PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
-    }
-};
+Writer::Writer(std::ostream& output, PrintSettings settings)
+    : output_(&output)
+    , settings_(settings) {
+    buffer_.reserve(BUFFER_SIZE);
+}
 
-void PrintNode(const Node& node, PrintContext ctx);
+Writer::Writer(PrintSettings settings, size_t depth)
+    : settings_(settings)
+    , base_depth_(depth) {
+}
 
-struct NodeValuePrinter {
-    PrintContext ctx;
+Writer::~Writer() {
+    Flush();
+}
 
-    void operator()(std::nullptr_t) {
-        ctx.out << "null"sv;
+void Writer::Flush() {
+    if (output_ == nullptr) {
+        return;
     }
+    output_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
 
-    void operator()(bool value) {
-        ctx.out << (value ? "true"sv : "false"sv);
-    }
+std::string_view Writer::GetFragment() const {
+    return buffer_;
+}
 
-    void operator()(int value) {
-        ctx.out << value;
-    }
+std::string Writer::ExtractFragment() {
+    return std::move(buffer_);
+}
+
+void Writer::Null() {
+    BeforeValue();
+    buffer_ += "null"sv;
+    AfterValue();
+}
 
-    void operator()(double value) {
-        ctx.out << value;
+void Writer::Bool(bool value) {
+    BeforeValue();
+    buffer_ += value ? "true"sv : "false"sv;
+    AfterValue();
+}
+
+void Writer::Int(int value) {
+    BeforeValue();
+    char chars[16];
+    auto [end, ec] = std::to_chars(std::begin(chars), std::end(chars), value);
+    buffer_.append(chars, end);
+    AfterValue();
+}
+
+// По умолчанию число выводится так же, как его выводит std::ostream: 6 значащих цифр
+void Writer::Double(double value) {
+    BeforeValue();
+    char chars[32];
+    auto [end, ec] = settings_.round_trip_doubles
+        ? std::to_chars(std::begin(chars), std::end(chars), value)
+        : std::to_chars(std::begin(chars), std::end(chars), value, std::chars_format::general, 6);
+    buffer_.append(chars, end);
+    AfterValue();
+}
+
+void Writer::String(std::string_view value) {
+    BeforeValue();
+    AppendString(value);
+    AfterValue();
+}
+
+void Writer::EncodedString(std::string_view, std::string_view json_text) {
+    RawValue(json_text);
+}
+
+void Writer::StartDict() {
+    BeforeValue();
+    OpenContainer('{');
+}
+
+void Writer::Key(std::string_view key) {
+    if (has_items_.empty() || after_key_) {
+        throw std::logic_error("Cannot put the key not in a dict."s);
     }
+    BeforeValue();
+    AppendString(key);
+    buffer_ += settings_.compact ? ":"sv : ": "sv;
+    after_key_ = true;
+}
 
-    void operator()(const std::string& string) {
-        ctx.out << '"';
-        for (const char ch : string) {
-            switch (ch) {
-                case '\\':
-                    ctx.out << "\\\\"s;
-                    break;
-                case '\n':
-                    ctx.out << "\\n"s;
-                    break;
-                case '\t':
-                    ctx.out << "\\t"s;
-                    break;
-                case '\r':
-                    ctx.out << "\\r"s;
-                    break;
-                case '"':
-                    ctx.out << "\\\""s;
-                    break;
-                default:
-                    ctx.out << ch;
-                    break;
-            }
-        }
-        ctx.out << '"';
+void Writer::EndDict() {
+    CloseContainer('}');
+}
+
+void Writer::StartArray() {
+    BeforeValue();
+    OpenContainer('[');
+}
+
+void Writer::EndArray() {
+    CloseContainer(']');
+}
+
+void Writer::Value(const Node& node) {
+    Emit(node, *this);
+}
+
+void Writer::RawValue(std::string_view text) {
+    BeforeValue();
+    buffer_ += text;
+    AfterValue();
+}
+
+void Writer::RawValue(std::initializer_list<std::string_view> parts) {
+    BeforeValue();
+    for (std::string_view part : parts) {
+        buffer_ += part;
     }
+    AfterValue();
+}
 
-    void operator()(const Array& array) {
-        std::ostream& out = ctx.out;
+// Ставит разделитель перед очередным элементом массива или ключом словаря.
+// После ключа разделитель уже выведен
+void Writer::BeforeValue() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (has_items_.empty()) {
+        return;
+    }
+    if (has_items_.back()) {
+        buffer_ += settings_.compact ? ","sv : ",\n"sv;
+    } else {
+        has_items_.back() = true;
+    }
+    AppendIndent();
+}
 
-        out << '[' << std::endl;
+void Writer::AfterValue() {
+    if (output_ != nullptr && buffer_.size() >= BUFFER_SIZE) {
+        Flush();
+    }
+}
 
-        PrintContext inner_ctx = ctx.Indented();
-        bool need_comma = false;
-        for (const Node& value : array) {
-            if (need_comma) {
-                ctx.out << ',' << std::endl;
-            } else {
-                need_comma = true;
-            }
-            inner_ctx.PrintIndent();
-            PrintNode(value, inner_ctx);
-        }
-        out << std::endl;
-        ctx.PrintIndent();
-        out << ']';
+void Writer::OpenContainer(char bracket) {
+    buffer_ += bracket;
+    if (!settings_.compact) {
+        buffer_ += '\n';
     }
+    has_items_.push_back(false);
+}
 
-    void operator()(const Dict& map) {
-        std::ostream& out = ctx.out;
+void Writer::CloseContainer(char bracket) {
+    if (has_items_.empty() || after_key_) {
+        throw std::logic_error("Node is not ready."s);
+    }
+    has_items_.pop_back();
+    if (!settings_.compact) {
+        buffer_ += '\n';
+        AppendIndent();
+    }
+    buffer_ += bracket;
+    AfterValue();
+}
 
-        out << '{' << std::endl;
+void Writer::AppendIndent() {
+    if (!settings_.compact) {
+        buffer_.append((base_depth_ + has_items_.size()) * INDENT_STEP, ' ');
+    }
+}
 
-        PrintContext inner_ctx = ctx.Indented();
-        bool need_comma = false;
-        for (const auto& [key, value] : map) {
-            if (need_comma) {
-                out << ',' << std::endl;
-            } else {
-                need_comma = true;
-            }
-            inner_ctx.PrintIndent();
-            out << '"' << key << "\": "s;
-            PrintNode(value, inner_ctx);
+// Участки без спецсимволов копируются целиком
+void Writer::AppendString(std::string_view string) {
+    buffer_ += '"';
+    auto run = string.begin();
+    for (auto it = string.begin(); it != string.end(); ++it) {
+        std::string_view escaped;
+        switch (*it) {
+            case '\\':
+                escaped = "\\\\"sv;
+                break;
+            case '\n':
+                escaped = "\\n"sv;
+                break;
+            case '\t':
+                escaped = "\\t"sv;
+                break;
+            case '\r':
+                escaped = "\\r"sv;
+                break;
+            case '"':
+                escaped = "\\\""sv;
+                break;
+            default:
+                continue;
         }
-        out << std::endl;
-        ctx.PrintIndent();
-        out << '}';
+        buffer_.append(run, it);
+        buffer_ += escaped;
+        run = it + 1;
     }
-};
-
-void PrintNode(const Node& node, PrintContext ctx) {
-    std::visit(NodeValuePrinter{ctx}, node.GetValue());
+    buffer_.append(run, string.end());
+    buffer_ += '"';
 }
 
-void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{output});
+void Print(const Document& doc, std::ostream& output, PrintSettings settings) {
+    Writer writer(output, settings);
+    writer.Value(doc.GetRoot());
 }
 
 }  // namespace json
@@ -1,19 +1,64 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace json {
 
 class Node;
-using Dict = std::map<std::string, Node>;
-using Array = std::vector<Node>;
-using Value = std::variant<std::nullptr_t, bool, int, double, std::string, Array, Dict>;
+
+// Словарь хранится плоским вектором, упорядоченным по ключу: объекты во входных данных
+// небольшие, и вектор для них быстрее дерева. Поиск по string_view не создаёт временных строк
+class Dict {
+public:
+    using value_type = std::pair<std::pmr::string, Node>;
+    using allocator_type = std::pmr::polymorphic_allocator<value_type>;
+    using iterator = std::pmr::vector<value_type>::iterator;
+    using const_iterator = std::pmr::vector<value_type>::const_iterator;
+
+    Dict() = default;
+    explicit Dict(const allocator_type& allocator);
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    size_t size() const;
+    bool empty() const;
+
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+    Node& at(std::string_view key);
+    const Node& at(std::string_view key) const;
+    Node& operator[](std::string_view key);
+    std::pair<iterator, bool> emplace(std::string_view key, Node value);
+
+    bool operator==(const Dict& other) const;
+    bool operator!=(const Dict& other) const;
+
+private:
+    std::pmr::vector<value_type> items_;
+
+    iterator LowerBound(std::string_view key);
+};
+
+// Строки и контейнеры используют polymorphic_allocator: Load размещает весь документ
+// в одной арене, которая освобождается целиком вместе с Document
+using Array = std::pmr::vector<Node>;
+using Value = std::variant<std::nullptr_t, bool, int, double, std::pmr::string, Array, Dict>;
 
 class ParsingError : public std::runtime_error {
 public:
@@ -42,26 +87,226 @@ public:
     int AsInt() const;
     bool AsBool() const;
     double AsDouble() const;
-    const std::string& AsString() const;
+    const std::pmr::string& AsString() const;
     const Array& AsArray() const;
     const Dict& AsDict() const;
+    Array& AsArray();
+    Dict& AsDict();
 };
 
+// Владеет ареной, из которой выделена память узлов, если документ получен через Load
 class Document {
 public:
-    explicit Document(Node root);
+    explicit Document(Node root, std::shared_ptr<std::pmr::memory_resource> arena = nullptr);
+    Document(const Document&) = default;
+    Document(Document&&) = default;
+    Document& operator=(const Document& other);
+    Document& operator=(Document&& other) noexcept;
 
     bool operator==(const Document& other) const;
     bool operator!=(const Document& other) const;
 
     const Node& GetRoot() const;
+    Node& GetRoot();
+    const std::shared_ptr<std::pmr::memory_resource>& GetArena() const;
 
 private:
+    std::shared_ptr<std::pmr::memory_resource> arena_;
     Node root_;
 };
 
+// Получатель событий потокового (SAX) разбора. Строки и ключи передаются как string_view,
+// действительные только до возврата из обработчика
+class Handler {
+public:
+    virtual ~Handler() = default;
+
+    virtual void Null() = 0;
+    virtual void Bool(bool value) = 0;
+    virtual void Int(int value) = 0;
+    virtual void Double(double value) = 0;
+    virtual void String(std::string_view value) = 0;
+    // Строка, для которой уже есть готовая запись в JSON: в кавычках и с экранированием.
+    // Обработчики, которым она не нужна, получают обычный String
+    virtual void EncodedString(std::string_view value, std::string_view json_text) {
+        (void)json_text;
+        String(value);
+    }
+    virtual void StartDict() = 0;
+    virtual void Key(std::string_view key) = 0;
+    virtual void EndDict() = 0;
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+};
+
+// Читает вход порциями и сообщает обработчику о каждом значении, не строя дерево Node.
+// Контейнеры верхних уровней можно обходить вручную через StartDict/NextKey и StartArray/NextItem.
+// Непрерывный вход (например, отображённый в память файл) разбирается без копирования
+class Parser {
+public:
+    explicit Parser(std::istream& input);
+    explicit Parser(std::string_view input);
+
+    void ParseValue(Handler& handler);
+    // Пропускает значение и возвращает его исходный текст. Только для непрерывного входа
+    std::string_view SkipValue();
+
+    void StartDict();
+    bool NextKey(std::string& key);
+    void StartArray();
+    bool NextItem();
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::istream* input_ = nullptr;
+    std::string chunk_;
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+    std::string scratch_;
+    std::vector<bool> has_items_;
+
+    bool Fill();
+    int Peek();
+    char Get();
+    void Expect(char expected);
+    void SkipSpaces();
+    bool NextElement(char close);
+
+    void ParseDict(Handler& handler);
+    void ParseArray(Handler& handler);
+    void ParseLiteral(std::string_view literal);
+    void ParseNumber(Handler& handler);
+    std::string_view ParseString();
+};
+
+// Первый этап разбора со структурным индексом: позиции структурных символов, открывающих кавычек
+// и начал скаляров вне строк. Вход классифицируется блоками по 64 байта векторными сравнениями
+// (AVX2, если его поддерживает процессор, иначе SSE2 или побайтно), а границы строк находятся
+// битовыми операциями над масками кавычек и обратных косых черт
+std::vector<size_t> BuildStructuralIndex(std::string_view input);
+
+// Второй этап: значения документа, записанные подряд в порядке обхода. Запись начала контейнера
+// хранит номер записи его конца, поэтому контейнер пропускается за один шаг. Строки без
+// escape-последовательностей ссылаются на вход, поэтому он должен жить, пока используется лента;
+// остальные распаковываются в общий буфер
+class Tape {
+public:
+    enum class Type : uint8_t {
+        NUL,
+        TRUE,
+        FALSE,
+        INT,
+        DOUBLE,
+        STRING,
+        KEY,
+        START_DICT,
+        END_DICT,
+        START_ARRAY,
+        END_ARRAY,
+    };
+
+    // Размечает вход структурным индексом и строит по нему ленту
+    explicit Tape(std::string_view input);
+
+    size_t size() const;
+    Type GetType(size_t index) const;
+    // Для записей STRING и KEY
+    std::string_view GetString(size_t index) const;
+    // Номер записи за значением, которое начинается в index
+    size_t Next(size_t index) const;
+    // Сообщает обработчику события значения, которое начинается в index, и возвращает Next(index)
+    size_t Emit(size_t index, Handler& handler) const;
+
+private:
+    friend class TapeBuilder;
+
+    // старший бит смещения строки отмечает строки, распакованные в strings_
+    static constexpr uint64_t UNESCAPED_STRING = uint64_t{1} << 63;
+
+    struct Entry {
+        Type type = Type::NUL;
+        uint32_t length = 0;  // длина строки
+        uint64_t payload = 0; // число, смещение строки или номер парной записи контейнера
+    };
+
+    std::string_view input_;
+    std::vector<Entry> entries_;
+    std::string strings_;
+
+    std::string_view GetEntryString(const Entry& entry) const;
+};
+
+void Parse(std::istream& input, Handler& handler);
+
 Document Load(std::istream& input);
+Document Load(std::string_view input);
+Document Load(Parser& parser);
+
+// Строит документ из событий, которые produce сообщает переданному ему обработчику
+Document BuildDocument(const std::function<void(Handler&)>& produce);
+
+// Сообщает обработчику события, описывающие значение node
+void Emit(const Node& node, Handler& handler);
+
+struct PrintSettings {
+    bool compact = false;            // без пробелов и переводов строк
+    bool round_trip_doubles = false; // кратчайшая запись double, по которой он восстанавливается точно
+};
+
+// Выводит JSON по событиям Handler. Текст копится в большом буфере и уходит в поток
+// крупными порциями, поэтому ответ можно выводить по частям, не строя дерево Node
+class Writer final : public Handler {
+public:
+    explicit Writer(std::ostream& output, PrintSettings settings = {});
+    // Пишет фрагмент в собственный буфер, без вывода в поток. Отступы считаются так,
+    // будто фрагмент вложен в другой документ на глубину depth
+    Writer(PrintSettings settings, size_t depth);
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    ~Writer() override;
+
+    void Null() override;
+    void Bool(bool value) override;
+    void Int(int value) override;
+    void Double(double value) override;
+    void String(std::string_view value) override;
+    // Копирует json_text без повторного экранирования
+    void EncodedString(std::string_view value, std::string_view json_text) override;
+    void StartDict() override;
+    void Key(std::string_view key) override;
+    void EndDict() override;
+    void StartArray() override;
+    void EndArray() override;
+
+    void Value(const Node& node);
+    // Вставляет готовое значение, например фрагмент, записанный другим Writer с той же глубиной
+    void RawValue(std::string_view text);
+    void RawValue(std::initializer_list<std::string_view> parts);
+    void Flush();
+    // Текст, записанный во фрагмент к текущему моменту
+    std::string_view GetFragment() const;
+    std::string ExtractFragment();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t INDENT_STEP = 4;
+
+    std::ostream* output_ = nullptr;
+    PrintSettings settings_;
+    size_t base_depth_ = 0;
+    std::string buffer_;
+    std::vector<bool> has_items_;
+    bool after_key_ = false;
+
+    void BeforeValue();
+    void AfterValue();
+    void OpenContainer(char bracket);
+    void CloseContainer(char bracket);
+    void AppendIndent();
+    void AppendString(std::string_view string);
+};
 
-void Print(const Document& doc, std::ostream& output);
+void Print(const Document& doc, std::ostream& output, PrintSettings settings = {});
 
 }  // namespace json
@@ -10,27 +10,30 @@ Builder::Builder()
     nodes_stack_.push_back(&root_);
 }
 
-DictValueContext Builder::Key(std::string string) {
+DictValueContext Builder::Key(std::string_view key) {
     IsNodeReady();
     if (nodes_stack_.back()->IsDict()) {
-        auto& dict = std::get<Dict>(nodes_stack_.back()->GetValue());
-        dict[string] = Node{nullptr};
-        nodes_stack_.push_back(&dict[string]);
+        Node& value = std::get<Dict>(nodes_stack_.back()->GetValue())[key];
+        value = Node{nullptr};
+        nodes_stack_.push_back(&value);
     } else {
         throw std::logic_error("Cannot put the key not in a dict."s);
     }
     return DictValueContext(*this);
 }
 
-BaseContext Builder::Value(json::Value value) {
+BaseContext Builder::Value(const json::Value& value) {
+    return Value(json::Value(value));
+}
+
+BaseContext Builder::Value(json::Value&& value) {
     IsNodeReady();
     if (nodes_stack_.back()->IsNull()) {
-        nodes_stack_.back()->GetValue() = value;
+        nodes_stack_.back()->GetValue() = std::move(value);
         nodes_stack_.pop_back();
     } else if (nodes_stack_.back()->IsArray()) {
         auto& array = std::get<Array>(nodes_stack_.back()->GetValue());
-        array.emplace_back(Node());
-        array.back().GetValue() = value;
+        array.emplace_back().GetValue() = std::move(value);
     } else {
         throw std::logic_error("Cannot put the value."s);
     }
@@ -88,7 +91,7 @@ Node Builder::Build() {
     if (!nodes_stack_.empty()) {
         throw std::logic_error("Node is not ready."s);
     }
-    return root_;
+    return std::move(root_);
 }
 
 void Builder::IsNodeReady() {
@@ -101,8 +104,8 @@ BaseContext::BaseContext(Builder& builder)
     : builder_(builder) {
 }
 
-DictValueContext BaseContext::Key(std::string string) {
-    return builder_.Key(std::move(string));
+DictValueContext BaseContext::Key(std::string_view key) {
+    return builder_.Key(key);
 }
 
 BaseContext BaseContext::Value(json::Value value) {
@@ -133,8 +136,8 @@ DictItemContext::DictItemContext(Builder& builder)
     : BaseContext(builder) {
 }
 
-DictValueContext DictItemContext::Key(std::string string) {
-    return BaseContext::Key(std::move(string));
+DictValueContext DictItemContext::Key(std::string_view key) {
+    return BaseContext::Key(key);
 }
 
 BaseContext DictItemContext::EndDict() {
@@ -3,6 +3,7 @@
 #include "json.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace json {
@@ -15,8 +16,9 @@ class ArrayItemContest;
 class Builder {
 public:
     Builder();
-    DictValueContext Key(std::string string);
-    BaseContext Value(json::Value value);
+    DictValueContext Key(std::string_view key);
+    BaseContext Value(const json::Value& value);
+    BaseContext Value(json::Value&& value);
     DictItemContext StartDict();
     ArrayItemContest StartArray();
     BaseContext EndDict();
@@ -33,7 +35,7 @@ private:
 class BaseContext {
 public:
     BaseContext(Builder& builder);
-    DictValueContext Key(std::string string);
+    DictValueContext Key(std::string_view key);
     BaseContext Value(json::Value value);
     DictItemContext StartDict();
     ArrayItemContest StartArray();
@@ -47,7 +49,7 @@ public:
 class DictItemContext : public BaseContext {
 public:
     DictItemContext(Builder& builder);
-    DictValueContext Key(std::string string);
+    DictValueContext Key(std::string_view key);
     BaseContext EndDict();
     Builder& Value(json::Value value) = delete;
     DictItemContext StartDict() = delete;
@@ -62,7 +64,7 @@ public:
     DictItemContext Value(json::Value value);
     DictItemContext StartDict();
     ArrayItemContest StartArray();
-    DictValueContext Key(std::string string) = delete;
+    DictValueContext Key(std::string_view key) = delete;
     BaseContext EndDict() = delete;
     BaseContext EndArray() = delete;
     Node Build() = delete;
@@ -75,7 +77,7 @@ public:
     DictItemContext StartDict();
     ArrayItemContest StartArray();
     BaseContext EndArray();
-    DictValueContext Key(std::string string) = delete;
+    DictValueContext Key(std::string_view key) = delete;
     BaseContext EndDict() = delete;
     Node Build() = delete;
 };
@@ -1,12 +1,19 @@
 #include "json_reader.h"
 
+#include "thread_pool.h"
+
 #include <algorithm>
+#include <charconv>
+#include <future>
+#include <iterator>
 #include <map>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <sstream>
 #include <string_view>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace transport {
@@ -16,27 +23,415 @@ using namespace std::literals;
 
 namespace detail {
 
-Requests ReadJson(std::istream& input) {
-    json::Dict all_requests = json::Load(input).GetRoot().AsDict();
+// Разделы переносятся из корня без копирования и продолжают ссылаться на арену исходного документа
+json::Document TakeSection(json::Document& document, std::string_view name) {
+    return json::Document{std::move(document.GetRoot().AsDict().at(name)), document.GetArena()};
+}
+
+// stat_requests можно не передавать: в режиме сервера запросы приходят отдельно от документа
+Requests ReadJson(json::Document document) {
+    if (document.GetRoot().AsDict().size() > 4) {
+        throw std::logic_error("Unknown JSON document."s);
+    }
+    const bool has_stat_requests = document.GetRoot().AsDict().count("stat_requests"sv) > 0;
+
+    return {TakeSection(document, "base_requests"sv),
+        has_stat_requests ? TakeSection(document, "stat_requests"sv) : json::Document{json::Array{}},
+        TakeSection(document, "render_settings"sv),
+        TakeSection(document, "routing_settings"sv)};
+}
+
+// Принимает события разбора элементов base_requests и складывает их в pending
+class BaseRequestHandler final : public json::Handler {
+public:
+    explicit BaseRequestHandler(PendingBaseRequests& pending)
+        : pending_(pending) {
+    }
+
+    void Null() override {
+    }
+
+    void Bool(bool value) override {
+        if (depth_ == 1 && key_ == "is_roundtrip"sv) {
+            is_roundtrip_ = value;
+        }
+    }
+
+    void Int(int value) override {
+        if (depth_ == 2 && field_ == "road_distances"sv) {
+            distances_.push_back({std::move(key_), value});
+        } else {
+            Double(value);
+        }
+    }
+
+    void Double(double value) override {
+        if (depth_ == 1 && key_ == "latitude"sv) {
+            coordinates_.lat = value;
+        } else if (depth_ == 1 && key_ == "longitude"sv) {
+            coordinates_.lng = value;
+        }
+    }
+
+    void String(std::string_view value) override {
+        if (depth_ == 1 && key_ == "type"sv) {
+            type_ = value;
+        } else if (depth_ == 1 && key_ == "name"sv) {
+            name_ = value;
+        } else if (depth_ == 2 && field_ == "stops"sv) {
+            stops_.emplace_back(value);
+        }
+    }
+
+    void StartDict() override {
+        if (depth_ == 0) {
+            Reset();
+        } else if (depth_ == 1) {
+            field_ = key_;
+        }
+        ++depth_;
+    }
+
+    void Key(std::string_view key) override {
+        key_ = key;
+    }
+
+    void EndDict() override {
+        if (--depth_ == 0) {
+            Commit();
+        }
+    }
+
+    void StartArray() override {
+        if (depth_ == 0) {
+            throw std::logic_error("Base request must be a dict."s);
+        } else if (depth_ == 1) {
+            field_ = key_;
+        }
+        ++depth_;
+    }
+
+    void EndArray() override {
+        --depth_;
+    }
+
+private:
+    PendingBaseRequests& pending_;
+
+    int depth_ = 0;
+    std::string key_;
+    std::string field_;
+    std::string type_;
+    std::string name_;
+    geo::Coordinates coordinates_ = {0., 0.};
+    std::vector<std::pair<std::string, int>> distances_;
+    std::vector<std::string> stops_;
+    bool is_roundtrip_ = false;
+
+    void Reset() {
+        type_.clear();
+        name_.clear();
+        coordinates_ = {0., 0.};
+        distances_.clear();
+        stops_.clear();
+        is_roundtrip_ = false;
+    }
+
+    void Commit() {
+        if (type_ == "Stop"sv) {
+            for (auto& [to, length] : distances_) {
+                pending_.distances.push_back({name_, std::move(to), length});
+            }
+            pending_.stops.push_back({std::move(name_), coordinates_});
+        } else if (type_ == "Bus"sv) {
+            pending_.buses.push_back({std::move(name_), std::move(stops_), is_roundtrip_});
+        }
+    }
+};
+
+template <typename Items>
+void AppendItems(Items& items, Items&& other) {
+    items.insert(items.end(), std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+}
+
+// Элементы base_requests разбираются пакетами в пуле из threads_count потоков. Пакеты сливаются в порядке документа,
+// поэтому остановки и маршруты попадают в каталог в том же порядке, что и при последовательном разборе
+void ReadBaseRequestsParallel(json::Parser& parser, PendingBaseRequests& pending, size_t threads_count) {
+    std::vector<std::string_view> items;
+    parser.StartArray();
+    while (parser.NextItem()) {
+        items.push_back(parser.SkipValue());
+    }
+
+    concurrency::ThreadPool pool(threads_count);
+    const size_t batches_count = std::min(items.size(), pool.GetThreadsCount() * 4);
+    std::vector<std::future<PendingBaseRequests>> batches;
+    batches.reserve(batches_count);
+    for (size_t i = 0; i < batches_count; ++i) {
+        const auto first = items.begin() + items.size() * i / batches_count;
+        const auto last = items.begin() + items.size() * (i + 1) / batches_count;
+        batches.push_back(pool.Submit([first, last] {
+            PendingBaseRequests batch;
+            BaseRequestHandler handler(batch);
+            for (auto item = first; item != last; ++item) {
+                json::Parser item_parser(*item);
+                item_parser.ParseValue(handler);
+            }
+            return batch;
+        }));
+    }
 
-    if (all_requests.size() > 4) {
+    for (auto& batch_future : batches) {
+        PendingBaseRequests batch = batch_future.get();
+        AppendItems(pending.stops, std::move(batch.stops));
+        AppendItems(pending.distances, std::move(batch.distances));
+        AppendItems(pending.buses, std::move(batch.buses));
+    }
+}
+
+// Элементы base_requests передаются из ленты обработчику потокового разбора, остальные разделы
+// собираются в документы. Лента освобождается сразу после чтения: документы и pending её не используют
+Requests ReadJsonTape(const std::optional<std::string_view>& input, PendingBaseRequests& pending) {
+    if (!input) {
+        throw std::invalid_argument("Indexed parsing needs contiguous input."s);
+    }
+    const json::Tape tape(*input);
+    if (tape.GetType(0) != json::Tape::Type::START_DICT) {
         throw std::logic_error("Unknown JSON document."s);
     }
+    auto load = [&tape](size_t index) {
+        return json::BuildDocument([&tape, index](json::Handler& builder) {
+            tape.Emit(index, builder);
+        });
+    };
+
+    std::optional<json::Document> stat_requests;
+    std::optional<json::Document> render_settings;
+    std::optional<json::Document> routing_settings;
+    bool has_base_requests = false;
+
+    const size_t end = tape.Next(0) - 1;
+    for (size_t index = 1; index < end; index = tape.Next(index)) {
+        const std::string_view key = tape.GetString(index++);
+        if (key == "base_requests"sv && !has_base_requests) {
+            if (tape.GetType(index) != json::Tape::Type::START_ARRAY) {
+                throw std::logic_error("base_requests must be an array."s);
+            }
+            BaseRequestHandler base_handler(pending);
+            for (size_t item = index + 1; item + 1 < tape.Next(index);) {
+                item = tape.Emit(item, base_handler);
+            }
+            has_base_requests = true;
+        } else if (key == "stat_requests"sv && !stat_requests) {
+            stat_requests = load(index);
+        } else if (key == "render_settings"sv && !render_settings) {
+            render_settings = load(index);
+        } else if (key == "routing_settings"sv && !routing_settings) {
+            routing_settings = load(index);
+        } else {
+            throw std::logic_error("Unknown JSON document."s);
+        }
+    }
+
+    if (!has_base_requests || !render_settings || !routing_settings) {
+        throw std::logic_error("Incomplete JSON document."s);
+    }
+    if (!stat_requests) {
+        stat_requests = json::Document{json::Array{}};
+    }
+
+    return {json::Document{json::Array{}},
+        std::move(*stat_requests),
+        std::move(*render_settings),
+        std::move(*routing_settings)};
+}
+
+// Если к началу stat_requests остальные разделы уже прочитаны, запросы не загружаются:
+// разборщик остаётся перед массивом, а stat_requests в результате равен null
+Requests ReadJsonStream(json::Parser& parser, PendingBaseRequests& pending, InputMode mode, size_t threads_count) {
+    std::optional<json::Document> stat_requests;
+    std::optional<json::Document> render_settings;
+    std::optional<json::Document> routing_settings;
+    bool has_base_requests = false;
+
+    parser.StartDict();
+    for (std::string key; parser.NextKey(key);) {
+        if (key == "base_requests"sv && !has_base_requests && mode == InputMode::PARALLEL) {
+            ReadBaseRequestsParallel(parser, pending, threads_count);
+            has_base_requests = true;
+        } else if (key == "base_requests"sv && !has_base_requests) {
+            BaseRequestHandler base_handler(pending);
+            parser.StartArray();
+            while (parser.NextItem()) {
+                parser.ParseValue(base_handler);
+            }
+            has_base_requests = true;
+        } else if (key == "stat_requests"sv && !stat_requests) {
+            if (has_base_requests && render_settings && routing_settings) {
+                return {json::Document{json::Array{}},
+                    json::Document{nullptr},
+                    std::move(*render_settings),
+                    std::move(*routing_settings)};
+            }
+            stat_requests = json::Load(parser);
+        } else if (key == "render_settings"sv && !render_settings) {
+            render_settings = json::Load(parser);
+        } else if (key == "routing_settings"sv && !routing_settings) {
+            routing_settings = json::Load(parser);
+        } else {
+            throw std::logic_error("Unknown JSON document."s);
+        }
+    }
+
+    if (!has_base_requests || !render_settings || !routing_settings) {
+        throw std::logic_error("Incomplete JSON document."s);
+    }
+    if (!stat_requests) {
+        stat_requests = json::Document{json::Array{}};
+    }
+
+    return {json::Document{json::Array{}},
+        std::move(*stat_requests),
+        std::move(*render_settings),
+        std::move(*routing_settings)};
+}
 
-    return {json::Document{json::Builder{}.Value(all_requests.at("base_requests"s).AsArray()).Build()},
-        json::Document{json::Builder{}.Value(all_requests.at("stat_requests"s).AsArray()).Build()},
-        json::Document{json::Builder{}.Value(all_requests.at("render_settings"s).AsDict()).Build()},
-        json::Document{json::Builder{}.Value(all_requests.at("routing_settings"s).AsDict()).Build()}};
+// Ключ, по которому совпадают запросы с одинаковым ответом. Пустой ключ — запрос не объединяется с другими
+std::string RequestKey(const json::Dict& request_info) {
+    const std::string_view type = request_info.at("type"sv).AsString();
+    std::string key(type);
+    if (type == "Stop"sv || type == "Bus"sv) {
+        key += '\0';
+        key += request_info.at("name"sv).AsString();
+    } else if (type == "Route"sv) {
+        key += '\0';
+        key += request_info.at("from"sv).AsString();
+        key += '\0';
+        key += request_info.at("to"sv).AsString();
+    } else if (type == "MapTile"sv) {
+        for (const std::string_view coordinate : {"z"sv, "x"sv, "y"sv}) {
+            key += '\0';
+            key += std::to_string(request_info.at(coordinate).AsInt());
+        }
+    } else if (type != "Map"sv) {
+        key.clear();
+    }
+    return key;
 }
 
+// Передаёт события ответа во фрагмент и запоминает, где в его тексте записано значение request_id
+class RequestIdLocator final : public json::Handler {
+public:
+    explicit RequestIdLocator(json::Writer& fragment)
+        : fragment_(fragment) {
+    }
+
+    size_t GetIdBegin() const {
+        return id_begin_;
+    }
+
+    size_t GetIdEnd() const {
+        return id_end_;
+    }
+
+    void Null() override {
+        fragment_.Null();
+    }
+
+    void Bool(bool value) override {
+        fragment_.Bool(value);
+    }
+
+    void Int(int value) override {
+        fragment_.Int(value);
+        if (at_request_id_) {
+            id_end_ = fragment_.GetFragment().size();
+            at_request_id_ = false;
+        }
+    }
+
+    void Double(double value) override {
+        fragment_.Double(value);
+    }
+
+    void String(std::string_view value) override {
+        fragment_.String(value);
+    }
+
+    void EncodedString(std::string_view value, std::string_view json_text) override {
+        fragment_.EncodedString(value, json_text);
+    }
+
+    void StartDict() override {
+        fragment_.StartDict();
+        ++depth_;
+    }
+
+    void Key(std::string_view key) override {
+        fragment_.Key(key);
+        if (depth_ == 1 && key == "request_id"sv) {
+            id_begin_ = fragment_.GetFragment().size();
+            at_request_id_ = true;
+        }
+    }
+
+    void EndDict() override {
+        fragment_.EndDict();
+        --depth_;
+    }
+
+    void StartArray() override {
+        fragment_.StartArray();
+        ++depth_;
+    }
+
+    void EndArray() override {
+        fragment_.EndArray();
+        --depth_;
+    }
+
+private:
+    json::Writer& fragment_;
+    int depth_ = 0;
+    bool at_request_id_ = false;
+    size_t id_begin_ = 0;
+    size_t id_end_ = 0;
+};
+
 } // namespace transport::json_reader::detail
 
-JsonReader::JsonReader(std::istream& input, TransportCatalogue& catalogue, handler::RequestHandler& handler)
-    : requests_(detail::ReadJson(input))
+JsonReader::JsonReader(std::istream& input, TransportCatalogue& catalogue,
+                       handler::RequestHandler& handler, InputMode mode, size_t threads_count)
+    : JsonReader(std::make_unique<json::Parser>(input), std::nullopt, catalogue, handler, mode, threads_count) {
+}
+
+JsonReader::JsonReader(std::string_view input, TransportCatalogue& catalogue,
+                       handler::RequestHandler& handler, InputMode mode, size_t threads_count)
+    : JsonReader(std::make_unique<json::Parser>(input), input, catalogue, handler, mode, threads_count) {
+}
+
+JsonReader::JsonReader(json::Document document, TransportCatalogue& catalogue, handler::RequestHandler& handler)
+    : requests_(detail::ReadJson(std::move(document)))
     , catalogue_(catalogue)
     , handler_(handler) {
 }
 
+JsonReader::JsonReader(std::unique_ptr<json::Parser> parser, std::optional<std::string_view> input,
+                       TransportCatalogue& catalogue, handler::RequestHandler& handler, InputMode mode,
+                       size_t threads_count)
+    : parser_(std::move(parser))
+    , requests_(mode == InputMode::DOCUMENT ? detail::ReadJson(json::Load(*parser_))
+                : mode == InputMode::INDEXED ? detail::ReadJsonTape(input, pending_)
+                                             : detail::ReadJsonStream(*parser_, pending_, mode,
+                                                                      std::max<size_t>(threads_count, 1)))
+    , catalogue_(catalogue)
+    , handler_(handler)
+    , threads_count_(std::max<size_t>(threads_count, 1)) {
+    if (mode == InputMode::DOCUMENT || mode == InputMode::INDEXED) {
+        parser_.reset();
+    }
+}
+
 const json::Document& JsonReader::TakeRenderSettings() const {
     return requests_.render_settings;
 }
@@ -48,16 +443,92 @@ const json::Document& JsonReader::TakeRoutingSettings() const {
 TransportCatalogue& JsonReader::BuildCatalogue() {
     LoadStops();
     LoadBuses();
+    LoadPending();
 
-    auto settings = requests_.routing_settings.GetRoot().AsDict();
-    graph::RouteSettings route_settings{settings.at("bus_wait_time"s).AsInt(), settings.at("bus_velocity"s).AsInt()};
+    const json::Dict& settings = requests_.routing_settings.GetRoot().AsDict();
+    graph::RouteSettings route_settings{settings.at("bus_wait_time"sv).AsInt(), settings.at("bus_velocity"sv).AsInt()};
     routes_graph_ = std::make_unique<graph::RoutesGraph>(graph::RoutesGraph(catalogue_, route_settings));
 
     return catalogue_;
 }
 
-void JsonReader::PrintStat(std::ostream& output) {
-    Print(ProcessRequests(), output);
+void JsonReader::SetThreadsCount(size_t threads_count) {
+    threads_count_ = std::max<size_t>(threads_count, 1);
+}
+
+void JsonReader::SetDeduplication(bool enabled) {
+    deduplicate_ = enabled;
+}
+
+const DedupStats& JsonReader::GetDedupStats() const {
+    return dedup_stats_;
+}
+
+void JsonReader::SetPipeline(bool enabled) {
+    pipeline_ = enabled;
+}
+
+// Ответы на все остановки и маршруты записываются подряд в одну строку. Текст совпадает с тем,
+// что выводит ProcessRequest на глубине 1, поэтому при ответе остаётся только подставить request_id
+void JsonReader::PrecomputeAnswers(json::PrintSettings settings) {
+    PrecomputedAnswers precomputed;
+    precomputed.settings = settings;
+    const std::deque<Stop>& stops = catalogue_.GetStopsList();
+    const std::deque<Bus>& buses = catalogue_.GetRoutesList();
+    precomputed.stops.reserve(stops.size());
+    precomputed.buses.reserve(buses.size());
+
+    auto append = [this, &precomputed](const CompiledRequest& request) {
+        json::Writer fragment(precomputed.settings, 1);
+        detail::RequestIdLocator locator(fragment);
+        ProcessRequest(request, locator);
+        const size_t begin = precomputed.arena.size();
+        precomputed.arena += fragment.GetFragment();
+        return PrecomputedAnswers::Entry{begin, begin + locator.GetIdBegin(), begin + locator.GetIdEnd(),
+                                         precomputed.arena.size()};
+    };
+    for (const Stop& stop : stops) {
+        CompiledRequest request;
+        request.kind = RequestKind::STOP;
+        request.stop = &stop;
+        precomputed.stops.emplace(&stop, append(request));
+    }
+    for (const Bus& bus : buses) {
+        CompiledRequest request;
+        request.kind = RequestKind::BUS;
+        request.bus = &bus;
+        precomputed.buses.emplace(&bus, append(request));
+    }
+    precomputed_ = std::move(precomputed);
+}
+
+void JsonReader::PrintStat(std::ostream& output, json::PrintSettings settings) {
+    json::Writer answers(output, settings);
+    if (pipeline_) {
+        AnswerInPipeline(settings, answers);
+        return;
+    }
+    if (threads_count_ == 1 && !deduplicate_ && !precomputed_) {
+        PrintStat(answers);
+        return;
+    }
+
+    std::optional<concurrency::ThreadPool> pool;
+    if (threads_count_ > 1) {
+        pool.emplace(threads_count_);
+    }
+    AnswerRequests(answers, STREAM_BATCH_SIZE,
+                   [this, &pool, settings, &answers](const std::vector<const json::Dict*>& batch) {
+        AnswerWithFragments(batch, pool ? &*pool : nullptr, settings, answers);
+    });
+}
+
+void JsonReader::PrintStat(json::Handler& answers) {
+    AnswerRequests(answers, 1, [this, &answers](const std::vector<const json::Dict*>& batch) {
+        for (const json::Dict* request : batch) {
+            ProcessRequest(CompileRequest(*request), answers);
+        }
+    });
 }
 
 void JsonReader::LoadStops() {
@@ -65,11 +536,11 @@ void JsonReader::LoadStops() {
 
     for (const auto& node : requests_.base_requests.GetRoot().AsArray()) {
         const json::Dict& data = node.AsDict();
-        if (data.at("type"s).AsString() == "Stop"sv) {
-            std::string_view stop_name = data.at("name"s).AsString();
+        if (data.at("type"sv).AsString() == "Stop"sv) {
+            std::string_view stop_name = data.at("name"sv).AsString();
             catalogue_.AddStop({std::string(stop_name),
-                {data.at("latitude"s).AsDouble(), data.at("longitude"s).AsDouble()}});
-                road_distances[stop_name] = &data.at("road_distances"s);
+                {data.at("latitude"sv).AsDouble(), data.at("longitude"sv).AsDouble()}});
+                road_distances[stop_name] = &data.at("road_distances"sv);
         }
     }
 
@@ -86,134 +557,528 @@ void JsonReader::LoadStops() {
 void JsonReader::LoadBuses() {
     for (const auto& node : requests_.base_requests.GetRoot().AsArray()) {
         const json::Dict& data = node.AsDict();
-        if (data.at("type").AsString() == "Bus"sv) {
+        if (data.at("type"sv).AsString() == "Bus"sv) {
             std::vector<std::string_view> route;
-            for (const auto& node : data.at("stops"s).AsArray()) {
+            for (const auto& node : data.at("stops"sv).AsArray()) {
                 route.push_back(node.AsString());
             }
 
-            catalogue_.AddBus(data.at("name"s).AsString(), route, data.at("is_roundtrip").AsBool());
+            catalogue_.AddBus(data.at("name"sv).AsString(), route, data.at("is_roundtrip"sv).AsBool());
         }
     }
 }
 
-json::Node JsonReader::ProcessStopRequest(const json::Dict& request_info) {
-    json::Builder stop_info;
+void JsonReader::LoadPending() {
+    for (Stop& stop : pending_.stops) {
+        catalogue_.AddStop(std::move(stop));
+    }
+
+    for (const auto& [from, to, length] : pending_.distances) {
+        const Stop* stop_to = catalogue_.GetStopInfo(to);
+        if (stop_to == nullptr) {
+            throw std::logic_error("Unknown stop "s + to + " in road_distances."s);
+        }
+        catalogue_.SetDistance(catalogue_.GetStopInfo(from), stop_to, length);
+    }
+
+    for (const auto& [name, stops, is_roundtrip] : pending_.buses) {
+        std::vector<std::string_view> route(stops.begin(), stops.end());
+        catalogue_.AddBus(name, route, is_roundtrip);
+    }
 
-    stop_info.StartDict()
-                .Key("request_id"s).Value(request_info.at("id"s).AsInt());
+    pending_ = {};
+}
+
+// Ответы выводятся прямо в Writer, минуя дерево json::Node. Ключи каждого ответа
+// перечисляются в алфавитном порядке, как их выводил бы json::Dict
+JsonReader::CompiledRequest JsonReader::CompileRequest(const json::Dict& request_info) const {
+    CompiledRequest request;
+    const std::string_view type = request_info.at("type"sv).AsString();
+    if (type == "Stop"sv) {
+        request.kind = RequestKind::STOP;
+        request.stop = catalogue_.GetStopInfo(request_info.at("name"sv).AsString());
+    } else if (type == "Bus"sv) {
+        request.kind = RequestKind::BUS;
+        request.bus = catalogue_.GetBusInfo(request_info.at("name"sv).AsString());
+    } else if (type == "Map"sv) {
+        request.kind = RequestKind::MAP;
+    } else if (type == "MapTile"sv) {
+        request.kind = RequestKind::MAP_TILE;
+        request.tile = {request_info.at("z"sv).AsInt(), request_info.at("x"sv).AsInt(),
+                        request_info.at("y"sv).AsInt()};
+    } else if (type == "Route"sv) {
+        request.kind = RequestKind::ROUTE;
+        request.stop = catalogue_.GetStopInfo(request_info.at("from"sv).AsString());
+        request.to = catalogue_.GetStopInfo(request_info.at("to"sv).AsString());
+    } else {
+        return request;
+    }
+    request.id = request_info.at("id"sv).AsInt();
+    return request;
+}
 
-    const std::set<std::string_view>* bus_list = handler_.GetBusesByStop(request_info.at("name"s).AsString());
+void JsonReader::ProcessStopRequest(const CompiledRequest& request, json::Handler& answer) {
+    const std::set<std::string_view>* bus_list = request.stop != nullptr
+        ? handler_.GetBusesByStop(request.stop->name) : nullptr;
     if (bus_list == nullptr) {
-        return stop_info.Key("error_message"s).Value("not found"s)
-                .EndDict()
-                .Build();
+        PrintNotFound(request.id, answer);
+        return;
     }
 
-    stop_info.Key("buses"s).StartArray();
+    answer.StartDict();
+    answer.Key("buses"sv);
+    answer.StartArray();
     for (const std::string_view bus : *bus_list) {
-        stop_info.Value(std::string(bus));
+        answer.String(bus);
     }
-
-    return stop_info.EndArray().EndDict().Build();
+    answer.EndArray();
+    answer.Key("request_id"sv);
+    answer.Int(request.id);
+    answer.EndDict();
 }
 
-json::Node JsonReader::ProcessBusRequest(const json::Dict& request_info) {
-    json::Builder bus_info;
-    bus_info.StartDict()
-               .Key("request_id"s).Value(request_info.at("id"s).AsInt());
-
-    const Bus* bus_stat = handler_.GetBusStat(request_info.at("name"s).AsString());
+void JsonReader::ProcessBusRequest(const CompiledRequest& request, json::Handler& answer) {
+    const Bus* bus_stat = request.bus;
     if (bus_stat == nullptr) {
-        return bus_info.Key("error_message"s).Value("not found"s)
-                .EndDict()
-                .Build();
+        PrintNotFound(request.id, answer);
+        return;
     }
 
-    bus_info.Key("stop_count"s).Value(bus_stat->GetStopsAmount())
-           .Key("route_length"s).Value(bus_stat->geo_length)
-           .Key("curvature"s).Value(bus_stat->ComputeCurvature())
-           .Key("unique_stop_count"s).Value(static_cast<int>(bus_stat->unique_stops_amount));
-
-    return bus_info.EndDict()
-                  .Build();
+    answer.StartDict();
+    answer.Key("curvature"sv);
+    answer.Double(bus_stat->ComputeCurvature());
+    answer.Key("request_id"sv);
+    answer.Int(request.id);
+    answer.Key("route_length"sv);
+    answer.Int(bus_stat->geo_length);
+    answer.Key("stop_count"sv);
+    answer.Int(bus_stat->GetStopsAmount());
+    answer.Key("unique_stop_count"sv);
+    answer.Int(static_cast<int>(bus_stat->unique_stops_amount));
+    answer.EndDict();
 }
 
-json::Node JsonReader::ProcessMapRequest(const json::Dict& request_info) {
-    std::ostringstream svg;
-    handler_.RenderMap(svg);
-    return json::Builder{}.StartDict()
-                              .Key("request_id"s).Value(request_info.at("id"s).AsInt())
-                              .Key("map"s).Value(svg.str())
-                          .EndDict()
-                          .Build();
+void JsonReader::ProcessMapRequest(const CompiledRequest& request, json::Handler& answer) {
+    const handler::RequestHandler::RenderedMap& map = handler_.GetMap();
+
+    answer.StartDict();
+    answer.Key("map"sv);
+    answer.EncodedString(map.svg, map.json);
+    answer.Key("request_id"sv);
+    answer.Int(request.id);
+    answer.EndDict();
 }
 
-json::Node JsonReader::ProcessRouteRequest(const json::Dict& request_info) {
-    json::Builder answer;
-    answer.StartDict()
-            .Key("request_id"s).Value(request_info.at("id"s).AsInt());
+void JsonReader::ProcessMapTileRequest(const CompiledRequest& request, json::Handler& answer) {
+    const std::shared_ptr<const handler::RequestHandler::RenderedMap> tile = handler_.GetMapTile(request.tile);
+    if (!tile) {
+        PrintNotFound(request.id, answer);
+        return;
+    }
+
+    answer.StartDict();
+    answer.Key("map"sv);
+    answer.EncodedString(tile->svg, tile->json);
+    answer.Key("request_id"sv);
+    answer.Int(request.id);
+    answer.EndDict();
+}
 
-    if (catalogue_.GetStopInfo(request_info.at("from"s).AsString()) == nullptr
-        || catalogue_.GetStopInfo(request_info.at("to"s).AsString()) == nullptr) {
-        return answer.Key("error_message"s).Value("not found"s)
-                    .EndDict()
-                    .Build();
+void JsonReader::ProcessRouteRequest(const CompiledRequest& request, json::Handler& answer) {
+    const int id = request.id;
+    if (request.stop == nullptr || request.to == nullptr) {
+        PrintNotFound(id, answer);
+        return;
     }
 
     if (!routes_graph_) {
         throw std::logic_error("Graph doesn't exist yet."s);
     }
 
-    auto route_info = routes_graph_->BuildRoute(catalogue_.GetStopInfo(request_info.at("from"s).AsString()),
-                                               catalogue_.GetStopInfo(request_info.at("to"s).AsString()));
-
+    auto route_info = routes_graph_->BuildRoute(request.stop, request.to);
     if (!route_info) {
-        answer.Key("error_message"s).Value("not found"s);
+        PrintNotFound(id, answer);
+        return;
+    }
+
+    answer.StartDict();
+    answer.Key("items"sv);
+    answer.StartArray();
+    for (const graph::RoutesGraph::EdgeInfo* edge_info : route_info->edges_info) {
+        answer.StartDict();
+        if (edge_info->from == edge_info->to) {
+            answer.Key("stop_name"sv);
+            answer.String(edge_info->from->name);
+            answer.Key("time"sv);
+            answer.Double(edge_info->weight);
+            answer.Key("type"sv);
+            answer.String("Wait"sv);
+        } else {
+            answer.Key("bus"sv);
+            answer.String(edge_info->bus->name);
+            answer.Key("span_count"sv);
+            answer.Int(edge_info->span_count);
+            answer.Key("time"sv);
+            answer.Double(edge_info->weight);
+            answer.Key("type"sv);
+            answer.String("Bus"sv);
+        }
+        answer.EndDict();
+    }
+    answer.EndArray();
+    answer.Key("request_id"sv);
+    answer.Int(id);
+    answer.Key("total_time"sv);
+    answer.Double(route_info->weight);
+    answer.EndDict();
+}
+
+void JsonReader::PrintNotFound(int id, json::Handler& answer) {
+    answer.StartDict();
+    answer.Key("error_message"sv);
+    answer.String("not found"sv);
+    answer.Key("request_id"sv);
+    answer.Int(id);
+    answer.EndDict();
+}
+
+void JsonReader::ProcessRequest(const CompiledRequest& request, json::Handler& answer) {
+    switch (request.kind) {
+    case RequestKind::STOP:
+        ProcessStopRequest(request, answer);
+        break;
+    case RequestKind::BUS:
+        ProcessBusRequest(request, answer);
+        break;
+    case RequestKind::MAP:
+        ProcessMapRequest(request, answer);
+        break;
+    case RequestKind::MAP_TILE:
+        ProcessMapTileRequest(request, answer);
+        break;
+    case RequestKind::ROUTE:
+        ProcessRouteRequest(request, answer);
+        break;
+    case RequestKind::UNKNOWN:
+        break;
+    }
+}
+
+// Передаёт запросы в answer_batch пакетами. Загруженные stat_requests передаются одним пакетом,
+// а читаемые потоково — пакетами по stream_batch_size запросов
+void JsonReader::AnswerRequests(json::Handler& answers, size_t stream_batch_size, const BatchAnswerer& answer_batch) {
+    answers.StartArray();
+    if (parser_ && requests_.stat_requests.GetRoot().IsNull()) {
+        StreamRequests(stream_batch_size, answer_batch);
     } else {
-        answer.Key("total_time"s).Value(route_info.value().weight)
-              .Key("items"s).StartArray();
-        
-        for (const graph::RoutesGraph::EdgeInfo* edge_info : route_info->edges_info) {
-            if (edge_info->from == edge_info->to) {
-                answer.StartDict()
-                        .Key("type"s).Value("Wait"s)
-                        .Key("stop_name"s).Value(edge_info->from->name)
-                        .Key("time").Value(edge_info->weight)
-                      .EndDict();
-            } else {
-                answer.StartDict()
-                        .Key("type"s).Value("Bus"s)
-                        .Key("bus"s).Value(edge_info->bus->name)
-                        .Key("span_count"s).Value(edge_info->span_count)
-                        .Key("time").Value(edge_info->weight)
-                      .EndDict();
+        std::vector<const json::Dict*> batch;
+        for (const json::Node& node_request : requests_.stat_requests.GetRoot().AsArray()) {
+            batch.push_back(&node_request.AsDict());
+        }
+        answer_batch(batch);
+    }
+    answers.EndArray();
+}
+
+// Читает stat_requests небольшими пакетами и сразу выводит ответы, так что в памяти
+// одновременно находится только текущий пакет
+void JsonReader::StreamRequests(size_t batch_size, const BatchAnswerer& answer_batch) {
+    std::vector<json::Document> documents;
+    std::vector<const json::Dict*> batch;
+    auto flush_batch = [&documents, &batch, &answer_batch] {
+        for (const json::Document& document : documents) {
+            batch.push_back(&document.GetRoot().AsDict());
+        }
+        answer_batch(batch);
+        documents.clear();
+        batch.clear();
+    };
+
+    parser_->StartArray();
+    while (parser_->NextItem()) {
+        documents.push_back(json::Load(*parser_));
+        if (documents.size() == batch_size) {
+            flush_batch();
+        }
+    }
+    if (!documents.empty()) {
+        flush_batch();
+    }
+
+    if (std::string key; parser_->NextKey(key)) {
+        throw std::logic_error("Unknown JSON document."s);
+    }
+    parser_.reset();
+}
+
+// Сначала запросы группируются по смыслу, и для каждой группы ответ готовится один раз:
+// в пуле потоков, если он есть. Затем ответы выводятся в исходном порядке,
+// а в ответ на повторный запрос подставляется его request_id
+void JsonReader::AnswerWithFragments(const std::vector<const json::Dict*>& batch, concurrency::ThreadPool* pool,
+                                     json::PrintSettings settings, json::Writer& answers) {
+    // заранее записанным ответам соответствует NO_ANSWER: они не готовятся, а копируются при выводе
+    static constexpr size_t NO_ANSWER = static_cast<size_t>(-1);
+    std::vector<size_t> answer_indexes;
+    answer_indexes.reserve(batch.size());
+    std::vector<CompiledRequest> plan;
+    plan.reserve(batch.size());
+    std::vector<const PrecomputedAnswers::Entry*> precomputed(batch.size(), nullptr);
+    std::vector<size_t> distinct_requests;
+    std::unordered_map<std::string, size_t> known_requests;
+    size_t distinct_precomputed = 0;
+    for (const json::Dict* request : batch) {
+        const size_t request_index = plan.size();
+        plan.push_back(CompileRequest(*request));
+        const PrecomputedAnswers::Entry* entry = FindPrecomputed(plan.back(), settings);
+        precomputed[request_index] = entry;
+        // повтор заранее записанного ответа тоже получает NO_ANSWER и учитывается в статистике как повтор
+        std::string key = deduplicate_ ? detail::RequestKey(*request) : std::string{};
+        if (!key.empty()) {
+            auto [it, inserted] = known_requests.emplace(std::move(key),
+                                                         entry != nullptr ? NO_ANSWER : distinct_requests.size());
+            if (!inserted) {
+                answer_indexes.push_back(it->second);
+                continue;
             }
         }
-        answer.EndArray();
+        if (entry != nullptr) {
+            ++distinct_precomputed;
+            answer_indexes.push_back(NO_ANSWER);
+            continue;
+        }
+        answer_indexes.push_back(distinct_requests.size());
+        distinct_requests.push_back(request_index);
+    }
+    dedup_stats_.requests += batch.size();
+    dedup_stats_.unique_answers += distinct_requests.size() + distinct_precomputed;
+
+    // Route-запросы с общей начальной остановкой выполняются подряд: они читают одну строку таблицы
+    // маршрутизатора, и она остаётся в кэше. Остальные запросы сохраняют исходный порядок
+    std::vector<size_t> execution_order(distinct_requests.size());
+    for (size_t index = 0; index < execution_order.size(); ++index) {
+        execution_order[index] = index;
+    }
+    auto route_source = [&plan, &distinct_requests](size_t index) -> const Stop* {
+        const CompiledRequest& request = plan[distinct_requests[index]];
+        return request.kind == RequestKind::ROUTE ? request.stop : nullptr;
+    };
+    std::stable_sort(execution_order.begin(), execution_order.end(), [&route_source](size_t lhs, size_t rhs) {
+        return std::less<const Stop*>{}(route_source(lhs), route_source(rhs));
+    });
+
+    std::vector<PreparedAnswer> prepared(distinct_requests.size());
+    auto prepare = [this, &plan, &distinct_requests, &execution_order, settings, &prepared](size_t position) {
+        const size_t index = execution_order[position];
+        prepared[index] = PrepareAnswer(plan[distinct_requests[index]], settings);
+    };
+    if (pool != nullptr) {
+        pool->ParallelFor(prepared.size(), PARALLEL_GRAIN_SIZE, prepare);
+    } else {
+        for (size_t index = 0; index < prepared.size(); ++index) {
+            prepare(index);
+        }
     }
 
-    return answer.EndDict().Build();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const size_t index = answer_indexes[i];
+        if (index == NO_ANSWER) {
+            WritePrecomputed(*precomputed[i], plan[i].id, answers);
+            continue;
+        }
+        const PreparedAnswer& answer = prepared[index];
+        if (answer.text.empty()) {
+            continue;
+        }
+        if (distinct_requests[index] == i) {
+            answers.RawValue(answer.text);
+            continue;
+        }
+        const std::string_view text = answer.text;
+        char id_chars[16];
+        auto [id_end, ec] = std::to_chars(std::begin(id_chars), std::end(id_chars), plan[i].id);
+        answers.RawValue({text.substr(0, answer.id_begin),
+            std::string_view(id_chars, static_cast<size_t>(id_end - id_chars)),
+            text.substr(answer.id_end)});
+    }
+}
 
+std::string JsonReader::AnswerRequest(const json::Dict& request_info, json::PrintSettings settings) {
+    json::Writer answer(settings, 0);
+    ProcessRequest(CompileRequest(request_info), answer);
+    return answer.ExtractFragment();
 }
 
-json::Document JsonReader::ProcessRequests() {
-    json::Builder answers;
+const JsonReader::PrecomputedAnswers::Entry* JsonReader::FindPrecomputed(const CompiledRequest& request,
+                                                                          json::PrintSettings settings) const {
+    if (!precomputed_ || precomputed_->settings.compact != settings.compact
+        || precomputed_->settings.round_trip_doubles != settings.round_trip_doubles) {
+        return nullptr;
+    }
+    if (request.kind == RequestKind::STOP && request.stop != nullptr) {
+        return &precomputed_->stops.at(request.stop);
+    }
+    if (request.kind == RequestKind::BUS && request.bus != nullptr) {
+        return &precomputed_->buses.at(request.bus);
+    }
+    return nullptr;
+}
+
+void JsonReader::WritePrecomputed(const PrecomputedAnswers::Entry& entry, int id, json::Writer& answers) const {
+    const std::string_view arena = precomputed_->arena;
+    char id_chars[16];
+    auto [id_end, ec] = std::to_chars(std::begin(id_chars), std::end(id_chars), id);
+    answers.RawValue({arena.substr(entry.begin, entry.id_begin - entry.begin),
+        std::string_view(id_chars, static_cast<size_t>(id_end - id_chars)),
+        arena.substr(entry.id_end, entry.end - entry.id_end)});
+}
+
+JsonReader::PreparedAnswer JsonReader::PrepareAnswer(const CompiledRequest& request, json::PrintSettings settings) {
+    if (const PrecomputedAnswers::Entry* entry = FindPrecomputed(request, settings)) {
+        const std::string_view arena = precomputed_->arena;
+        PreparedAnswer answer;
+        answer.text.reserve(entry->end - entry->begin + 8);
+        answer.text.append(arena.substr(entry->begin, entry->id_begin - entry->begin));
+        answer.id_begin = answer.text.size();
+        answer.text += std::to_string(request.id);
+        answer.id_end = answer.text.size();
+        answer.text.append(arena.substr(entry->id_end, entry->end - entry->id_end));
+        return answer;
+    }
+    json::Writer fragment(settings, 1);
+    detail::RequestIdLocator locator(fragment);
+    ProcessRequest(request, locator);
+    return {fragment.ExtractFragment(), locator.GetIdBegin(), locator.GetIdEnd()};
+}
+
+// Поток разбора передаёт запросы исполнителям, а те возвращают готовые фрагменты ответов.
+// Фрагменты приходят не по порядку, поэтому до вывода они ждут в кольце waiting_answers. Перед каждым
+// запросом поток разбора занимает место в окне free_slots, а место освобождается после вывода ответа,
+// поэтому при отстающем выводе разбор ждёт, а кольцо не переполняется.
+// При ошибке на любой стадии остальные стадии дочитывают свои очереди, чтобы никто не остался ждать
+void JsonReader::AnswerInPipeline(json::PrintSettings settings, json::Writer& answers) {
+    struct PipelineRequest {
+        size_t index = 0;
+        const json::Dict* request = nullptr;
+        std::optional<json::Document> document;
+        bool is_last = false;
+    };
+
+    struct PipelineAnswer {
+        size_t index = 0;
+        std::string text;
+        bool is_last = false;
+    };
+
+    const size_t workers_count = threads_count_;
+    concurrency::BoundedQueue<PipelineRequest> requests(PIPELINE_QUEUE_SIZE);
+    concurrency::BoundedQueue<PipelineAnswer> prepared(PIPELINE_QUEUE_SIZE);
+    concurrency::BoundedQueue<bool> free_slots(PIPELINE_REORDER_WINDOW);
+    for (size_t i = 0; i < PIPELINE_REORDER_WINDOW; ++i) {
+        free_slots.Push(true);
+    }
+    std::atomic_bool failed = false;
+    concurrency::ThreadPool pool(workers_count + 1);
+
+    std::future<void> parsing = pool.Submit([this, workers_count, &requests, &free_slots, &failed] {
+        auto finish = [workers_count, &requests] {
+            for (size_t i = 0; i < workers_count; ++i) {
+                PipelineRequest last;
+                last.is_last = true;
+                requests.Push(std::move(last));
+            }
+        };
+        try {
+            size_t index = 0;
+            if (parser_ && requests_.stat_requests.GetRoot().IsNull()) {
+                parser_->StartArray();
+                while (!failed && parser_->NextItem()) {
+                    free_slots.Pop();
+                    PipelineRequest request;
+                    request.index = index++;
+                    request.document = json::Load(*parser_);
+                    requests.Push(std::move(request));
+                }
+                if (std::string key; !failed && parser_->NextKey(key)) {
+                    throw std::logic_error("Unknown JSON document."s);
+                }
+            } else {
+                for (const json::Node& node_request : requests_.stat_requests.GetRoot().AsArray()) {
+                    if (failed) {
+                        break;
+                    }
+                    free_slots.Pop();
+                    PipelineRequest request;
+                    request.index = index++;
+                    request.request = &node_request.AsDict();
+                    requests.Push(std::move(request));
+                }
+            }
+        } catch (...) {
+            failed = true;
+            finish();
+            throw;
+        }
+        finish();
+    });
+
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < workers_count; ++i) {
+        workers.push_back(pool.Submit([this, settings, &requests, &prepared, &free_slots, &failed] {
+            std::exception_ptr error;
+            for (PipelineRequest request = requests.Pop(); !request.is_last; request = requests.Pop()) {
+                // после ошибки ответы не выводятся, поэтому место в окне освобождает сам исполнитель
+                if (failed) {
+                    free_slots.Push(true);
+                    continue;
+                }
+                try {
+                    const json::Dict& request_info = request.document ? request.document->GetRoot().AsDict()
+                                                                      : *request.request;
+                    prepared.Push({request.index, PrepareAnswer(CompileRequest(request_info), settings).text});
+                } catch (...) {
+                    error = std::current_exception();
+                    failed = true;
+                    free_slots.Push(true);
+                }
+            }
+            PipelineAnswer last;
+            last.is_last = true;
+            prepared.Push(std::move(last));
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }));
+    }
+
     answers.StartArray();
-    for (const json::Node& node_request : requests_.stat_requests.GetRoot().AsArray()) {
-        const json::Dict& request_info = node_request.AsDict();
-        if (request_info.at("type"s).AsString() == "Stop"sv) {
-            answers.Value(ProcessStopRequest(request_info));
-        } else if (request_info.at("type"s).AsString() == "Bus"sv) {
-            answers.Value(ProcessBusRequest(request_info));
-        } else if (request_info.at("type"s).AsString() == "Map"sv) {
-            answers.Value(ProcessMapRequest(request_info));
-        } else if (request_info.at("type"s).AsString() == "Route"sv) {
-            answers.Value(ProcessRouteRequest(request_info));
+    std::vector<std::optional<std::string>> waiting_answers(PIPELINE_REORDER_WINDOW);
+    size_t next_index = 0;
+    for (size_t finished_workers = 0; finished_workers < workers_count;) {
+        PipelineAnswer answer = prepared.Pop();
+        if (answer.is_last) {
+            ++finished_workers;
+            continue;
+        }
+        waiting_answers[answer.index % PIPELINE_REORDER_WINDOW] = std::move(answer.text);
+        for (std::optional<std::string>* ready = &waiting_answers[next_index % PIPELINE_REORDER_WINDOW];
+             ready->has_value(); ready = &waiting_answers[next_index % PIPELINE_REORDER_WINDOW]) {
+            if (!(*ready)->empty()) {
+                answers.RawValue(**ready);
+            }
+            ready->reset();
+            ++next_index;
+            free_slots.Push(true);
         }
     }
 
-    return json::Document{answers.EndArray().Build()};
+    parsing.get();
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    if (parser_ && requests_.stat_requests.GetRoot().IsNull()) {
+        parser_.reset();
+    }
+    answers.EndArray();
 }
 
 } // namespace transport::json_reader
@@ -5,49 +5,190 @@
 #include "request_handler.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
+#include "thread_pool.h"
+#include "concurrent_queue.h"
 
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace transport {
 
 namespace json_reader {
 
+enum class InputMode {
+    DOCUMENT, // весь документ сначала разбирается в дерево json::Node
+    STREAM,   // base_requests передаются в каталог прямо во время разбора
+    PARALLEL, // как STREAM, но base_requests разбираются пакетами в пуле из threads_count потоков;
+              // нужен непрерывный вход
+    INDEXED,  // вход размечается структурным индексом и переводится в ленту json::Tape,
+              // из которой base_requests передаются в каталог без дерева; нужен непрерывный вход
+};
+
+// base_requests, прочитанные при потоковом разборе. В каталог они передаются после разбора всего
+// массива: расстояния и маршруты могут ссылаться на ещё не прочитанные остановки
+struct PendingBaseRequests {
+    struct Distance {
+        std::string from;
+        std::string to;
+        int length = 0;
+    };
+
+    struct Route {
+        std::string name;
+        std::vector<std::string> stops;
+        bool is_roundtrip = false;
+    };
+
+    std::vector<Stop> stops;
+    std::vector<Distance> distances;
+    std::vector<Route> buses;
+};
+
 struct Requests {
     json::Document base_requests;
-    json::Document stat_requests;
+    json::Document stat_requests; // null, если запросы читаются потоково уже в PrintStat
     json::Document render_settings;
     json::Document routing_settings;
 };
 
+// Сколько stat_requests обработано и сколько различных ответов на них пришлось посчитать
+struct DedupStats {
+    size_t requests = 0;
+    size_t unique_answers = 0;
+};
+
 class JsonReader {
 public:
 
+    // threads_count задаёт число потоков уже при разборе, как если бы сразу был вызван SetThreadsCount
     JsonReader(std::istream& input, TransportCatalogue& catalogue, 
-               handler::RequestHandler& handler);
+               handler::RequestHandler& handler, InputMode mode = InputMode::DOCUMENT, size_t threads_count = 1);
+    // input должен оставаться доступным, пока идёт чтение запросов
+    JsonReader(std::string_view input, TransportCatalogue& catalogue,
+               handler::RequestHandler& handler, InputMode mode = InputMode::DOCUMENT, size_t threads_count = 1);
+    // Документ, уже разобранный из другого формата, например CBOR
+    JsonReader(json::Document document, TransportCatalogue& catalogue, handler::RequestHandler& handler);
 
     const json::Document& TakeRenderSettings() const;
     const json::Document& TakeRoutingSettings() const;
 
     TransportCatalogue& BuildCatalogue();
 
-    void PrintStat(std::ostream& output);
+    // При нескольких потоках ответы готовятся параллельно в отдельных буферах и выводятся в исходном порядке
+    void SetThreadsCount(size_t threads_count);
+    // Одинаковые запросы, отличающиеся только id, обрабатываются один раз, а готовый ответ
+    // выводится под каждым request_id
+    void SetDeduplication(bool enabled);
+    const DedupStats& GetDedupStats() const;
+    // Разбор запросов, вычисление ответов и их вывод идут одновременно: поток разбора и потоки-исполнители
+    // связаны ограниченными очередями без блокировок, а вывод идёт в вызывающем потоке в исходном порядке
+    void SetPipeline(bool enabled);
+    // Записывает ответы на все запросы Stop и Bus в один буфер, после чего такие запросы обрабатываются
+    // копированием готового текста. Вызывается после BuildCatalogue; ответы используются, только если
+    // PrintStat выводит их с теми же settings
+    void PrecomputeAnswers(json::PrintSettings settings = {});
+
+    void PrintStat(std::ostream& output, json::PrintSettings settings = {});
+    // Ответы передаются событиями обработчику, например cbor::Writer. Запросы обрабатываются в одном потоке
+    void PrintStat(json::Handler& answers);
+
+    // Ответ на отдельный запрос в виде текста JSON; пустая строка, если тип запроса неизвестен.
+    // Можно вызывать из нескольких потоков одновременно
+    std::string AnswerRequest(const json::Dict& request_info, json::PrintSettings settings = {});
 
 private:
+    static constexpr size_t STREAM_BATCH_SIZE = 4096;
+    static constexpr size_t PARALLEL_GRAIN_SIZE = 16;
+    static constexpr size_t PIPELINE_QUEUE_SIZE = 1024;
+    // Сколько запросов может быть разобрано, но ещё не выведено; степень двойки
+    static constexpr size_t PIPELINE_REORDER_WINDOW = 4096;
+
+    // Ответ, записанный во фрагмент; request_id занимает в тексте диапазон [id_begin, id_end)
+    struct PreparedAnswer {
+        std::string text;
+        size_t id_begin = 0;
+        size_t id_end = 0;
+    };
+
+    enum class RequestKind {
+        STOP,
+        BUS,
+        MAP,
+        MAP_TILE,
+        ROUTE,
+        UNKNOWN,
+    };
+
+    // stat-запрос, у которого тип уже определён, а остановки и маршрут найдены в каталоге.
+    // Для Route в stop хранится начальная остановка, а в to — конечная
+    struct CompiledRequest {
+        RequestKind kind = RequestKind::UNKNOWN;
+        int id = 0;
+        const Stop* stop = nullptr;
+        const Stop* to = nullptr;
+        const Bus* bus = nullptr;
+        map_renderer::TileId tile;
+    };
+
+    // Ответы на Stop и Bus, записанные на глубине 1. Тексты лежат подряд в arena, а для каждого имени
+    // хранятся границы ответа и диапазон request_id в нём
+    struct PrecomputedAnswers {
+        struct Entry {
+            size_t begin = 0;
+            size_t id_begin = 0;
+            size_t id_end = 0;
+            size_t end = 0;
+        };
+        json::PrintSettings settings;
+        std::string arena;
+        std::unordered_map<const Stop*, Entry> stops;
+        std::unordered_map<const Bus*, Entry> buses;
+    };
+
+    std::unique_ptr<json::Parser> parser_;
+    PendingBaseRequests pending_;
     Requests requests_;
     TransportCatalogue& catalogue_;
     std::unique_ptr<graph::RoutesGraph> routes_graph_;
     handler::RequestHandler& handler_;
+    size_t threads_count_ = 1;
+    bool deduplicate_ = false;
+    bool pipeline_ = false;
+    DedupStats dedup_stats_;
+    std::optional<PrecomputedAnswers> precomputed_;
+
+    using BatchAnswerer = std::function<void(const std::vector<const json::Dict*>& batch)>;
+
+    // input задан, только если вход непрерывный
+    JsonReader(std::unique_ptr<json::Parser> parser, std::optional<std::string_view> input,
+               TransportCatalogue& catalogue, handler::RequestHandler& handler, InputMode mode, size_t threads_count);
 
     void LoadStops();
     void LoadBuses();
+    void LoadPending();
 
-    json::Node ProcessStopRequest(const json::Dict& request_info);
-    json::Node ProcessBusRequest(const json::Dict& request_info);
-    json::Node ProcessMapRequest(const json::Dict& request_info);
-    json::Node ProcessRouteRequest(const json::Dict& request_info);
-    json::Document ProcessRequests();
+    CompiledRequest CompileRequest(const json::Dict& request_info) const;
+    void ProcessStopRequest(const CompiledRequest& request, json::Handler& answer);
+    void ProcessBusRequest(const CompiledRequest& request, json::Handler& answer);
+    void ProcessMapRequest(const CompiledRequest& request, json::Handler& answer);
+    void ProcessMapTileRequest(const CompiledRequest& request, json::Handler& answer);
+    void ProcessRouteRequest(const CompiledRequest& request, json::Handler& answer);
+    void PrintNotFound(int id, json::Handler& answer);
+    void ProcessRequest(const CompiledRequest& request, json::Handler& answer);
+    void AnswerRequests(json::Handler& answers, size_t stream_batch_size, const BatchAnswerer& answer_batch);
+    void StreamRequests(size_t batch_size, const BatchAnswerer& answer_batch);
+    void AnswerWithFragments(const std::vector<const json::Dict*>& batch, concurrency::ThreadPool* pool,
+                             json::PrintSettings settings, json::Writer& answers);
+    const PrecomputedAnswers::Entry* FindPrecomputed(const CompiledRequest& request, json::PrintSettings settings) const;
+    void WritePrecomputed(const PrecomputedAnswers::Entry& entry, int id, json::Writer& answers) const;
+    PreparedAnswer PrepareAnswer(const CompiledRequest& request, json::PrintSettings settings);
+    void AnswerInPipeline(json::PrintSettings settings, json::Writer& answers);
 };
 
 } // namespace transport::json_reader
@@ -2,20 +2,177 @@
 #include "transport_catalogue.h"
 #include "request_handler.h"
 #include "map_renderer.h"
+#include "file_io.h"
+#include "cbor.h"
+#include "server.h"
 
 #include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
 
 using namespace transport;
 using namespace std::literals;
 
-int main() {
+// Ошибки записи, отложенные буфером вывода, обнаруживаются только при сбросе
+int FinishOutput(std::ostream& output) {
+    output.flush();
+    if (!output) {
+        std::cerr << "Failed to write output"sv << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    json_reader::InputMode input_mode = json_reader::InputMode::DOCUMENT;
+    json::PrintSettings print_settings;
+    std::string input_path;
+    std::string output_path;
+    bool cbor_format = false;
+    size_t threads_count = 1;
+    bool deduplicate = false;
+    bool pipeline = false;
+    bool precompute = false;
+    bool compact_svg = false;
+    std::string socket_path;
+    bool serve_stdio = false;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == "--stream"sv) {
+            input_mode = json_reader::InputMode::STREAM;
+        } else if (argv[i] == "--parallel"sv) {
+            input_mode = json_reader::InputMode::PARALLEL;
+        } else if (argv[i] == "--simd-index"sv) {
+            input_mode = json_reader::InputMode::INDEXED;
+        } else if (argv[i] == "--compact"sv) {
+            print_settings.compact = true;
+        } else if (argv[i] == "--compact-svg"sv) {
+            compact_svg = true;
+        } else if (argv[i] == "--round-trip-doubles"sv) {
+            print_settings.round_trip_doubles = true;
+        } else if (argv[i] == "--cbor"sv) {
+            cbor_format = true;
+        } else if (argv[i] == "--pipeline"sv) {
+            pipeline = true;
+        } else if (argv[i] == "--precompute"sv) {
+            precompute = true;
+        } else if (argv[i] == "--dedup"sv) {
+            deduplicate = true;
+        } else if (argv[i] == "--serve"sv && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argv[i] == "--serve-stdio"sv) {
+            serve_stdio = true;
+        } else if (argv[i] == "--threads"sv && i + 1 < argc) {
+            threads_count = std::stoul(argv[++i]);
+        } else if (argv[i] == "--input"sv && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (argv[i] == "--output"sv && i + 1 < argc) {
+            output_path = argv[++i];
+        } else {
+            std::cerr << "Unknown option: "sv << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (pipeline && (deduplicate || cbor_format)) {
+        std::cerr << "--pipeline cannot be combined with --dedup or --cbor"sv << std::endl;
+        return 1;
+    }
+    // ответы в CBOR выводятся по одному через обработчик, минуя дедупликацию и готовые ответы
+    if (cbor_format && (deduplicate || precompute)) {
+        std::cerr << "--cbor cannot be combined with --dedup or --precompute"sv << std::endl;
+        return 1;
+    }
+    if (serve_stdio && input_path.empty()) {
+        std::cerr << "--serve-stdio reads requests from stdin, so the catalogue needs --input"sv << std::endl;
+        return 1;
+    }
+    if (cbor_format && input_mode != json_reader::InputMode::DOCUMENT) {
+        std::cerr << "--cbor cannot be combined with --stream, --parallel or --simd-index"sv << std::endl;
+        return 1;
+    }
+
+    // пулы потоков создаются уже при разборе входа, а маску сигналов потоки наследуют при запуске
+    if (!socket_path.empty()) {
+        server::BlockStopSignals();
+    }
+
+    // входной файл отображается в память и разбирается без копирования,
+    // поэтому он должен жить, пока читаются запросы
+    std::optional<file_io::MappedFile> input_file;
+    std::optional<file_io::OutputFile> output_file;
+    try {
+        if (!input_path.empty()) {
+            input_file.emplace(input_path);
+        }
+        if (!output_path.empty()) {
+            output_file.emplace(output_path);
+        }
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // параллельному и индексному разбору и CBOR нужен весь вход целиком, поэтому без --input он читается из std::cin заранее
+    std::string input_text;
+    std::optional<std::string_view> input_data;
+    if (input_file) {
+        input_data = input_file->GetData();
+    } else if (cbor_format || input_mode == json_reader::InputMode::PARALLEL
+               || input_mode == json_reader::InputMode::INDEXED) {
+        input_text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        input_data = input_text;
+    }
+    std::ostream& output = output_file ? *output_file : std::cout;
+
     TransportCatalogue catalogue;
     map_renderer::MapRenderer renderer;
     handler::RequestHandler request_handler(catalogue, renderer);
 
-    json_reader::JsonReader json_reader(std::cin, catalogue, request_handler);
+    json_reader::JsonReader json_reader = cbor_format
+        ? json_reader::JsonReader(cbor::Load(*input_data), catalogue, request_handler)
+        : input_data
+            ? json_reader::JsonReader(*input_data, catalogue, request_handler, input_mode, threads_count)
+            : json_reader::JsonReader(std::cin, catalogue, request_handler, input_mode, threads_count);
     json_reader.BuildCatalogue();
+    json_reader.SetThreadsCount(threads_count);
+    json_reader.SetDeduplication(deduplicate);
+    json_reader.SetPipeline(pipeline);
+    if (precompute) {
+        json_reader.PrecomputeAnswers(print_settings);
+    }
 
     renderer.SetSettings(json_reader.TakeRenderSettings());
-    json_reader.PrintStat(std::cout);
+    renderer.SetThreadsCount(threads_count);
+    renderer.SetCompactSvg(compact_svg);
+
+    // в режиме сервера stat_requests из документа не обрабатываются: запросы приходят построчно
+    if (!socket_path.empty() || serve_stdio) {
+        server::Server server(json_reader, threads_count);
+        if (serve_stdio) {
+            std::ios::sync_with_stdio(false);
+            server.ServeStream(std::cin, output);
+            return FinishOutput(output);
+        }
+        server.ServeUnixSocket(socket_path);
+        return 0;
+    }
+
+    if (cbor_format) {
+        cbor::Writer answers(output);
+        json_reader.PrintStat(answers);
+    } else {
+        json_reader.PrintStat(output, print_settings);
+    }
+
+    if (deduplicate) {
+        const json_reader::DedupStats& stats = json_reader.GetDedupStats();
+        std::cerr << "Deduplicated requests: "sv << stats.requests - stats.unique_answers << " of "sv << stats.requests;
+        if (stats.requests > 0) {
+            std::cerr << " ("sv << 100. * (stats.requests - stats.unique_answers) / stats.requests << "%)"sv;
+        }
+        std::cerr << std::endl;
+    }
+    return FinishOutput(output);
 }
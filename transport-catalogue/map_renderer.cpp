@@ -1,7 +1,11 @@
 #include "map_renderer.h"
 
+#include <array>
 #include <cmath>
+#include <limits>
 #include <map>
+#include <numeric>
+#include <stdexcept>
 
 namespace map_renderer {
 
@@ -11,6 +15,17 @@ bool IsZero(double value) {
     return std::abs(value) < EPSILON;
 }
 
+namespace {
+
+// Число символов UTF-8: байты продолжения не считаются
+size_t CountCharacters(std::string_view text) {
+    return static_cast<size_t>(std::count_if(text.begin(), text.end(), [](char ch) {
+        return (static_cast<unsigned char>(ch) & 0xC0) != 0x80;
+    }));
+}
+
+} // namespace
+
 void MapRenderer::SetSettings(const json::Document& render_settings) {
     for (const auto& [setting_name, node] : render_settings.GetRoot().AsDict()) {
         if (setting_name == "width"sv) {
@@ -37,6 +52,8 @@ void MapRenderer::SetSettings(const json::Document& render_settings) {
             render_settings_.underlayer_color = ProcessColorSetting(node);
         } else if (setting_name == "underlayer_width"sv) {
             render_settings_.underlayer_width = node.AsDouble();
+        } else if (setting_name == "simplify_tolerance"sv) {
+            render_settings_.simplify_tolerance = node.AsDouble();
         } else if (setting_name == "color_palette"sv) {
             for (const json::Node& color_node : node.AsArray()) {
                 render_settings_.color_palette.push_back(ProcessColorSetting(color_node));
@@ -45,171 +62,542 @@ void MapRenderer::SetSettings(const json::Document& render_settings) {
             throw std::logic_error("Unknown render setting."s);
         }
     }
+    ClearMapObjects();
+    ++settings_version_;
 }
 
-void MapRenderer::RenderMapObjects(const std::deque<transport::Bus>& buses) {
-    std::vector<const transport::Bus*> routes;
-    for (const auto& bus : buses) {
-        routes.push_back(&bus);
-    }
+size_t MapRenderer::GetSettingsVersion() const {
+    return settings_version_;
+}
 
+void MapRenderer::ClearMapObjects() {
+    objects_to_draw_.Clear();
+    routes_.clear();
+    stops_.clear();
+    projector_.reset();
+    grid_ = SpatialGrid();
+    has_grid_ = false;
+    routes_lods_.clear();
+    has_objects_to_draw_ = false;
+}
+
+void MapRenderer::RenderMapObjects(const std::deque<transport::Bus>& buses) {
     if (has_objects_to_draw_) {
         return;
     }
-    std::sort(routes.begin(), routes.end(), [](const transport::Bus* lhs,
-                                               const transport::Bus* rhs) {return lhs->name < rhs->name; });
 
+    // маршруты без остановок не рисуются и не занимают цвет палитры
+    routes_.clear();
+    routes_.reserve(buses.size());
+    for (const auto& bus : buses) {
+        if (!bus.route.empty()) {
+            routes_.push_back(&bus);
+        }
+    }
+    std::sort(routes_.begin(), routes_.end(), [](const transport::Bus* lhs,
+                                                 const transport::Bus* rhs) {return lhs->name < rhs->name; });
+    if (!routes_.empty() && render_settings_.color_palette.empty()) {
+        throw std::logic_error("Color palette is empty."s);
+    }
+
+    // остановки собираются за один проход: уже встреченные отмечаются по id
     std::vector<geo::Coordinates> all_geo_coords;
-    std::vector<const transport::Stop*> all_stops;
+    stops_.clear();
+    std::vector<bool> is_collected;
 
-    for (const transport::Bus* bus : routes) {
+    for (const transport::Bus* bus : routes_) {
         for (const transport::Stop* stop : bus->route) {
-            if (std::find(all_stops.begin(), all_stops.end(), stop) == all_stops.end()) {
+            if (stop->id >= is_collected.size()) {
+                is_collected.resize(stop->id + 1);
+            }
+            if (!is_collected[stop->id]) {
+                is_collected[stop->id] = true;
                 all_geo_coords.push_back(stop->coordinates);
-                all_stops.push_back(stop);
+                stops_.push_back(stop);
             }
         }
     }
 
-    const SphereProjector proj{
-        all_geo_coords.begin(), all_geo_coords.end(),
-        render_settings_.width, render_settings_.height, render_settings_.padding
+    projector_.emplace(all_geo_coords.begin(), all_geo_coords.end(),
+                       render_settings_.width, render_settings_.height, render_settings_.padding);
+    std::sort(stops_.begin(), stops_.end(), [](const transport::Stop* lhs,
+                                               const transport::Stop* rhs) {return lhs->name < rhs->name; });
+
+    std::vector<size_t> routes(routes_.size());
+    std::iota(routes.begin(), routes.end(), 0);
+    std::vector<size_t> stops(stops_.size());
+    std::iota(stops.begin(), stops.end(), 0);
+    routes_lods_.assign(MAX_TILE_ZOOM + 1, std::nullopt);
+    RenderScene(objects_to_draw_, routes, stops, *projector_, GetRoutesLod(0));
+    has_objects_to_draw_ = true;
+}
+
+// Размер сетки растёт как корень из числа остановок, чтобы в ячейке было в среднем немного объектов
+void MapRenderer::BuildGrid() {
+    const size_t cells_per_side = std::clamp<size_t>(static_cast<size_t>(std::sqrt(stops_.size())),
+                                                     1, MAX_GRID_CELLS_PER_SIDE);
+    grid_ = SpatialGrid(render_settings_.width, render_settings_.height, cells_per_side);
+    has_grid_ = true;
+    label_extent_ = EstimateLabelExtent();
+    for (size_t index = 0; index < stops_.size(); ++index) {
+        grid_.AddStop((*projector_)(stops_[index]->coordinates), index);
+    }
+    for (size_t index = 0; index < routes_.size(); ++index) {
+        const std::vector<const transport::Stop*>& route = routes_[index]->route;
+        svg::Point previous = (*projector_)(route.front()->coordinates);
+        grid_.AddRouteSegment(previous, previous, index);
+        for (size_t i = 1; i < route.size(); ++i) {
+            const svg::Point current = (*projector_)(route[i]->coordinates);
+            grid_.AddRouteSegment(previous, current, index);
+            previous = current;
+        }
+    }
+}
+
+// Ширина оценивается по самому длинному названию, поэтому запас от точки привязки годится для любой подписи
+double MapRenderer::EstimateLabelExtent() const {
+    size_t route_name_length = 0;
+    for (const transport::Bus* bus : routes_) {
+        route_name_length = std::max(route_name_length, CountCharacters(bus->name));
+    }
+    size_t stop_name_length = 0;
+    for (const transport::Stop* stop : stops_) {
+        stop_name_length = std::max(stop_name_length, CountCharacters(stop->name));
+    }
+
+    auto extent = [](size_t name_length, int font_size, svg::Point offset) {
+        const double width = LABEL_CHAR_WIDTH * font_size * static_cast<double>(name_length);
+        return std::max<double>(font_size, width) + std::hypot(offset.x, offset.y);
     };
+    return std::max(extent(route_name_length, render_settings_.bus_label_font_size, render_settings_.bus_label_offset),
+                    extent(stop_name_length, render_settings_.stop_label_font_size,
+                           render_settings_.stop_label_offset));
+}
 
-    RenderRoutes(routes, proj);
-    RenderRoutesNames(routes, proj);
+// Слои строятся в пуле в отдельных сценах с теми же стилями и затем дописываются в scene по порядку
+void MapRenderer::RenderScene(svg::Scene& scene, const std::vector<size_t>& routes, const std::vector<size_t>& stops,
+                              const SphereProjector& proj, const RoutesLod* lod) const {
+    scene.SetCompact(compact_svg_);
+    const SceneStyles styles = AddStyles(scene);
+    if (!pool_ || routes.size() + stops.size() < PARALLEL_LAYERS_MIN_OBJECTS) {
+        RenderRoutes(scene, styles, routes, proj, lod);
+        RenderRoutesNames(scene, styles, routes, proj);
+        RenderStopsSymbols(scene, styles, stops, proj);
+        RenderStopsNames(scene, styles, stops, proj);
+        return;
+    }
 
-    std::sort(all_stops.begin(), all_stops.end(), [](const transport::Stop* lhs,
-                                               const transport::Stop* rhs) {return lhs->name < rhs->name; });
-    RenderStopsSymbols(all_stops, proj);
-    RenderStopsNames(all_stops, proj);
-    has_objects_to_draw_ = true;
+    std::array<svg::Scene, 4> layers;
+    pool_->ParallelFor(layers.size(), 1, [&](size_t index) {
+        svg::Scene& layer = layers[index];
+        layer.SetCompact(compact_svg_);
+        const SceneStyles layer_styles = AddStyles(layer);
+        switch (index) {
+        case 0:
+            RenderRoutes(layer, layer_styles, routes, proj, lod);
+            break;
+        case 1:
+            RenderRoutesNames(layer, layer_styles, routes, proj);
+            break;
+        case 2:
+            RenderStopsSymbols(layer, layer_styles, stops, proj);
+            break;
+        default:
+            RenderStopsNames(layer, layer_styles, stops, proj);
+            break;
+        }
+    });
+    for (const svg::Scene& layer : layers) {
+        scene.Append(layer);
+    }
+}
+
+// Упрощает линии маршрутов для увеличения в 2^zoom раз. Допуск задан в пикселях итогового изображения,
+// поэтому в координатах всей карты он уменьшается с увеличением. nullptr, если упрощение выключено
+const MapRenderer::RoutesLod* MapRenderer::GetRoutesLod(int zoom) {
+    if (render_settings_.simplify_tolerance <= 0.) {
+        return nullptr;
+    }
+    std::optional<RoutesLod>& lod = routes_lods_[zoom];
+    if (lod) {
+        return &*lod;
+    }
+
+    const double tolerance = render_settings_.simplify_tolerance / (1 << zoom);
+    lod.emplace();
+    lod->reserve(routes_.size());
+    std::vector<svg::Point> points;
+    for (const transport::Bus* bus : routes_) {
+        points.clear();
+        for (const transport::Stop* stop : bus->route) {
+            points.push_back((*projector_)(stop->coordinates));
+        }
+        if (!bus->is_round) {
+            for (auto ptr = bus->route.rbegin() + 1; ptr != bus->route.rend(); ++ptr) {
+                points.push_back((*projector_)((*ptr)->coordinates));
+            }
+        }
+        lod->push_back(SimplifyPolyline(points, tolerance));
+    }
+    return &*lod;
+}
+
+bool MapRenderer::DrawTile(const TileId& tile, std::string& output) {
+    if (!has_objects_to_draw_ || tile.zoom < 0 || tile.zoom > MAX_TILE_ZOOM) {
+        return false;
+    }
+    const int tiles_per_side = 1 << tile.zoom;
+    if (tile.x < 0 || tile.x >= tiles_per_side || tile.y < 0 || tile.y >= tiles_per_side) {
+        return false;
+    }
+
+    const double scale = tiles_per_side;
+    const svg::Point origin{render_settings_.width * tile.x / scale, render_settings_.height * tile.y / scale};
+    const svg::Point end{render_settings_.width * (tile.x + 1) / scale, render_settings_.height * (tile.y + 1) / scale};
+
+    // сетка нужна только плиткам, поэтому строится при первой из них
+    if (!has_grid_) {
+        BuildGrid();
+    }
+
+    // толщина линий и размер шрифта на плитке не масштабируются, поэтому запас вокруг плитки
+    // уменьшается с увеличением. Подписи отбираются по точке привязки с запасом на их оценённый размер.
+    // Сетка хранит исходные отрезки маршрутов, а упрощённая линия может отходить от них на допуск
+    const RoutesLod* lod = GetRoutesLod(tile.zoom);
+    double margin = std::max({render_settings_.line_width, render_settings_.stop_radius, label_extent_})
+                    + render_settings_.underlayer_width;
+    if (lod != nullptr) {
+        margin += render_settings_.simplify_tolerance;
+    }
+    margin /= scale;
+    std::vector<size_t> routes;
+    std::vector<size_t> stops;
+    grid_.Query({origin.x - margin, origin.y - margin}, {end.x + margin, end.y + margin}, routes, stops);
+
+    svg::Scene scene;
+    RenderScene(scene, routes, stops, projector_->Zoomed(scale, origin), lod);
+    scene.Render(output);
+    return true;
 }
 
 void MapRenderer::DrawMap(std::ostream& output) {
     objects_to_draw_.Render(output);
 }
 
-void MapRenderer::RenderRoutes(std::vector<const transport::Bus*>& routes,
-                           const SphereProjector& proj) {
+void MapRenderer::DrawMap(std::string& output) {
+    const size_t objects_count = objects_to_draw_.GetObjectsCount();
+    if (!pool_ || objects_count <= DRAW_CHUNK_SIZE) {
+        objects_to_draw_.Render(output);
+        return;
+    }
+
+    const size_t chunks_count = (objects_count + DRAW_CHUNK_SIZE - 1) / DRAW_CHUNK_SIZE;
+    std::vector<std::string> chunks(chunks_count);
+    pool_->ParallelFor(chunks_count, 1, [this, objects_count, &chunks](size_t index) {
+        const size_t begin = index * DRAW_CHUNK_SIZE;
+        objects_to_draw_.RenderObjects(chunks[index], begin, std::min(begin + DRAW_CHUNK_SIZE, objects_count));
+    });
+
+    size_t total_size = output.size();
+    for (const std::string& chunk : chunks) {
+        total_size += chunk.size();
+    }
+    output.reserve(total_size + 128);
+    objects_to_draw_.RenderHeader(output);
+    for (const std::string& chunk : chunks) {
+        output += chunk;
+    }
+    objects_to_draw_.RenderFooter(output);
+}
+
+void MapRenderer::SetThreadsCount(size_t threads_count) {
+    threads_count = std::max<size_t>(threads_count, 1);
+    if (threads_count == threads_count_) {
+        return;
+    }
+    threads_count_ = threads_count;
+    pool_.reset();
+    if (threads_count_ > 1) {
+        pool_ = std::make_unique<concurrency::ThreadPool>(threads_count_);
+    }
+}
+
+// Уже построенная карта и закэшированные плитки выведены в прежнем виде, поэтому строятся заново
+void MapRenderer::SetCompactSvg(bool compact) {
+    if (compact_svg_ == compact) {
+        return;
+    }
+    compact_svg_ = compact;
+    ClearMapObjects();
+    ++settings_version_;
+}
+
+// Стиль обводки, общий для подложек названий
+svg::PathStyle MapRenderer::MakeUnderlayerStyle() const {
+    svg::PathStyle style;
+    style.fill_color = render_settings_.underlayer_color;
+    style.stroke_color = render_settings_.underlayer_color;
+    style.stroke_width = render_settings_.underlayer_width;
+    style.line_cap = render_settings_.stroke_linecap;
+    style.line_join = render_settings_.stroke_linejoin;
+    return style;
+}
+
+MapRenderer::SceneStyles MapRenderer::AddStyles(svg::Scene& scene) const {
+    SceneStyles styles;
+    for (const svg::Color& color : render_settings_.color_palette) {
+        svg::PathStyle style;
+        style.fill_color = render_settings_.fill_color;
+        style.stroke_color = color;
+        style.stroke_width = render_settings_.line_width;
+        style.line_cap = render_settings_.stroke_linecap;
+        style.line_join = render_settings_.stroke_linejoin;
+        styles.route_lines.push_back(scene.AddStyle(std::move(style)));
+    }
+
+    svg::TextStyle route_label;
+    route_label.offset = render_settings_.bus_label_offset;
+    route_label.font_size = render_settings_.bus_label_font_size;
+    route_label.font_family = "Verdana"s;
+    route_label.font_weight = "bold"s;
+    for (const svg::Color& color : render_settings_.color_palette) {
+        svg::TextStyle style = route_label;
+        style.path.fill_color = color;
+        styles.route_labels.push_back(scene.AddTextStyle(std::move(style)));
+    }
+    route_label.path = MakeUnderlayerStyle();
+    styles.route_label_underlayer = scene.AddTextStyle(std::move(route_label));
+
+    svg::PathStyle stop_symbol;
+    stop_symbol.fill_color = "white"s;
+    styles.stop_symbol = scene.AddStyle(std::move(stop_symbol));
+
+    svg::TextStyle stop_label;
+    stop_label.offset = render_settings_.stop_label_offset;
+    stop_label.font_size = render_settings_.stop_label_font_size;
+    stop_label.font_family = "Verdana"s;
+    stop_label.path.fill_color = "black"s;
+    styles.stop_label = scene.AddTextStyle(stop_label);
+    stop_label.path = MakeUnderlayerStyle();
+    styles.stop_label_underlayer = scene.AddTextStyle(std::move(stop_label));
+    return styles;
+}
 
-    size_t color_number = 0;
-    for (const transport::Bus* bus : routes) {
-        if (bus->route.empty()) {
+// Цвет маршрута определяется его номером среди всех маршрутов, поэтому на плитке он тот же, что на карте
+void MapRenderer::RenderRoutes(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& routes,
+                               const SphereProjector& proj, const RoutesLod* lod) const {
+    for (const size_t index : routes) {
+        const transport::Bus* bus = routes_[index];
+        scene.AddPolyline(styles.route_lines[index % styles.route_lines.size()]);
+        if (lod != nullptr) {
+            // ломаная идёт по остановкам маршрута, а у некольцевого — и обратно
+            const size_t stops_count = bus->route.size();
+            for (const uint32_t point : (*lod)[index]) {
+                const size_t stop_index = point < stops_count ? point : 2 * stops_count - 2 - point;
+                scene.AddPoint(proj(bus->route[stop_index]->coordinates));
+            }
             continue;
         }
-        std::vector<geo::Coordinates> geo_coords;
         for (const transport::Stop* stop : bus->route) {
-            geo_coords.push_back(stop->coordinates);
+            scene.AddPoint(proj(stop->coordinates));
         }
         if (!bus->is_round) {
             for (auto ptr = bus->route.rbegin() + 1; ptr != bus->route.rend(); ++ptr) {
-                const transport::Stop* stop = *ptr;
-                geo_coords.push_back(stop->coordinates);
+                scene.AddPoint(proj((*ptr)->coordinates));
             }
         }
+    }
+}
 
-        svg::Polyline svg_route;
-        for (const auto& geo_coord : geo_coords) {
-            svg_route.AddPoint(proj(geo_coord));
-        }
+void MapRenderer::RenderRoutesNames(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& routes,
+                                    const SphereProjector& proj) const {
+    for (const size_t index : routes) {
+        const transport::Bus* bus = routes_[index];
+        const svg::Scene::TextStyleId label_style = styles.route_labels[index % styles.route_labels.size()];
+        // название маршрута, кольцевой или нет + координаты либо первой, либо первой и последней остановки
 
-        objects_to_draw_.Add(svg_route
-                             .SetFillColor(render_settings_.fill_color)
-                             .SetStrokeColor(render_settings_.color_palette[color_number])
-                             .SetStrokeWidth(render_settings_.line_width)
-                             .SetStrokeLineCap(render_settings_.stroke_linecap)
-                             .SetStrokeLineJoin(render_settings_.stroke_linejoin));
+        const svg::Point first_position = proj(bus->route[0]->coordinates);
+        scene.AddText(first_position, bus->name, styles.route_label_underlayer);
+        scene.AddText(first_position, bus->name, label_style);
 
-        if (color_number < render_settings_.color_palette.size() - 1) {
-            ++color_number;
-        } else {
-            color_number = 0;
+        if (bus->route[0] != bus->route[bus->route.size() - 1]
+            && !bus->is_round) {
+            const svg::Point last_position = proj(bus->route[bus->route.size() - 1]->coordinates);
+            scene.AddText(last_position, bus->name, styles.route_label_underlayer);
+            scene.AddText(last_position, bus->name, label_style);
         }
     }
 }
 
-void MapRenderer::RenderRoutesNames(std::vector<const transport::Bus*>& routes,
-                    const SphereProjector& proj) {
-    size_t color_number = 0;
-    for (const transport::Bus* bus : routes) {
-        if (bus->route.empty()) {
-            continue;
-        }
-        // название маршрута, кольцевой или нет + координаты либо первой, либо первой и последней остановки
+void MapRenderer::RenderStopsSymbols(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& stops,
+                                     const SphereProjector& proj) const {
+    for (const size_t index : stops) {
+        scene.AddCircle(proj(stops_[index]->coordinates), render_settings_.stop_radius, styles.stop_symbol);
+    }
+}
 
-        svg::Text route_name1 = Text()
-                    .SetData(bus->name)
-                    .SetOffset(render_settings_.bus_label_offset)
-                    .SetFontSize(render_settings_.bus_label_font_size)
-                    .SetFontFamily("Verdana"s)
-                    .SetFontWeight("bold"s)
-                    .SetPosition(proj(bus->route[0]->coordinates))
-                    .SetFillColor(render_settings_.color_palette[color_number]);
+void MapRenderer::RenderStopsNames(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& stops,
+                                   const SphereProjector& proj) const {
+    for (const size_t index : stops) {
+        const transport::Stop* stop = stops_[index];
+        const svg::Point position = proj(stop->coordinates);
+        scene.AddText(position, stop->name, styles.stop_label_underlayer);
+        scene.AddText(position, stop->name, styles.stop_label);
+    }
+}
 
-        svg::Text underlayer1 = route_name1;
-        objects_to_draw_.Add(underlayer1.SetFillColor(render_settings_.underlayer_color)
-                   .SetStrokeColor(render_settings_.underlayer_color)
-                   .SetStrokeWidth(render_settings_.underlayer_width)
-                   .SetStrokeLineCap(render_settings_.stroke_linecap)
-                   .SetStrokeLineJoin(render_settings_.stroke_linejoin));
+// ---------- Douglas–Peucker ------------------
 
-        objects_to_draw_.Add(route_name1);
+namespace {
 
+double DistanceToSegment(svg::Point point, svg::Point from, svg::Point to) {
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    const double length_squared = dx * dx + dy * dy;
+    double t = 0.;
+    if (length_squared > 0.) {
+        t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length_squared, 0., 1.);
+    }
+    return std::hypot(point.x - (from.x + t * dx), point.y - (from.y + t * dy));
+}
 
-        if (bus->route[0] != bus->route[bus->route.size() - 1]
-            && !bus->is_round) {
-            svg::Text route_name2 = route_name1;
-            svg::Text underlayer2 = underlayer1;
+} // namespace
+
+// Оставляет первую и последнюю точки и рекурсивно — самую далёкую от отрезка между крайними точками,
+// пока она дальше tolerance. Рекурсия заменена стеком, чтобы длинные маршруты не переполняли стек вызовов
+std::vector<uint32_t> SimplifyPolyline(const std::vector<svg::Point>& points, double tolerance) {
+    std::vector<uint32_t> kept;
+    if (points.size() <= 2) {
+        for (uint32_t i = 0; i < points.size(); ++i) {
+            kept.push_back(i);
+        }
+        return kept;
+    }
 
-            objects_to_draw_.Add(underlayer2.SetPosition(proj(bus->route[bus->route.size() - 1]->coordinates)));
-            objects_to_draw_.Add(route_name2.SetPosition(proj(bus->route[bus->route.size() - 1]->coordinates)));
+    std::vector<bool> is_kept(points.size());
+    is_kept.front() = true;
+    is_kept.back() = true;
+    std::vector<std::pair<size_t, size_t>> ranges{{0, points.size() - 1}};
+    while (!ranges.empty()) {
+        const auto [first, last] = ranges.back();
+        ranges.pop_back();
+        double max_distance = 0.;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const double distance = DistanceToSegment(points[i], points[first], points[last]);
+            if (distance > max_distance) {
+                max_distance = distance;
+                farthest = i;
+            }
+        }
+        if (max_distance > tolerance) {
+            is_kept[farthest] = true;
+            ranges.push_back({first, farthest});
+            ranges.push_back({farthest, last});
+        }
+    }
+
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        if (is_kept[i]) {
+            kept.push_back(i);
         }
+    }
+    return kept;
+}
+
+// ---------- SpatialGrid ------------------
 
-        if (color_number < render_settings_.color_palette.size() - 1) {
-            ++color_number;
+SpatialGrid::SpatialGrid(double width, double height, size_t cells_per_side)
+    : cell_width_(std::max(width, EPSILON) / cells_per_side)
+    , cell_height_(std::max(height, EPSILON) / cells_per_side)
+    , cells_per_side_(cells_per_side)
+    , cells_(cells_per_side * cells_per_side) {
+}
+
+void SpatialGrid::AddStop(svg::Point point, size_t stop_index) {
+    cells_[GetCellIndex(GetColumn(point.x), GetRow(point.y))].stops.push_back(stop_index);
+}
+
+// Отрезок заносится в ячейки, через которые он проходит: от ячейки начала к ячейке конца
+// шагом в соседнюю по столбцу или строке — в ту, чью границу отрезок пересекает раньше
+void SpatialGrid::AddRouteSegment(svg::Point from, svg::Point to, size_t route_index) {
+    size_t column = GetColumn(from.x);
+    size_t row = GetRow(from.y);
+    const size_t last_column = GetColumn(to.x);
+    const size_t last_row = GetRow(to.y);
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    const double infinity = std::numeric_limits<double>::infinity();
+    // доля отрезка до следующей границы столбца или строки и доля, за которую проходится одна ячейка
+    double next_column_t = dx == 0. ? infinity : ((column + (dx > 0. ? 1 : 0)) * cell_width_ - from.x) / dx;
+    double next_row_t = dy == 0. ? infinity : ((row + (dy > 0. ? 1 : 0)) * cell_height_ - from.y) / dy;
+    const double column_step_t = dx == 0. ? infinity : cell_width_ / std::abs(dx);
+    const double row_step_t = dy == 0. ? infinity : cell_height_ / std::abs(dy);
+
+    AddRouteToCell(column, row, route_index);
+    size_t steps = (column > last_column ? column - last_column : last_column - column)
+                 + (row > last_row ? row - last_row : last_row - row);
+    for (; steps > 0; --steps) {
+        if (column != last_column && (next_column_t < next_row_t || row == last_row)) {
+            column = column < last_column ? column + 1 : column - 1;
+            next_column_t += column_step_t;
         } else {
-            color_number = 0;
+            row = row < last_row ? row + 1 : row - 1;
+            next_row_t += row_step_t;
         }
+        AddRouteToCell(column, row, route_index);
     }
 }
 
-void MapRenderer::RenderStopsSymbols(std::vector<const transport::Stop*> stops,
-                                  const SphereProjector& proj) {
-    for (const transport::Stop* stop : stops) {
-        objects_to_draw_.Add(Circle()
-                             .SetCenter(proj(stop->coordinates))
-                             .SetRadius(render_settings_.stop_radius)
-                             .SetFillColor("white"s));
+void SpatialGrid::AddRouteToCell(size_t column, size_t row, size_t route_index) {
+    std::vector<size_t>& routes = cells_[GetCellIndex(column, row)].routes;
+    if (routes.empty() || routes.back() != route_index) {
+        routes.push_back(route_index);
     }
 }
 
-void MapRenderer::RenderStopsNames(std::vector<const transport::Stop*> stops,
-                                const SphereProjector& proj) {
-    for (const transport::Stop* stop : stops) {
-        svg::Text stop_name = Text()
-                    .SetPosition(proj(stop->coordinates))
-                    .SetOffset(render_settings_.stop_label_offset)
-                    .SetFontSize(render_settings_.stop_label_font_size)
-                    .SetFontFamily("Verdana"s)
-                    .SetFillColor("black"s)
-                    .SetData(stop->name);
+void SpatialGrid::Query(svg::Point min, svg::Point max, std::vector<size_t>& routes, std::vector<size_t>& stops) const {
+    if (cells_.empty()) {
+        return;
+    }
+    const size_t first_column = GetColumn(min.x);
+    const size_t last_column = GetColumn(max.x);
+    const size_t first_row = GetRow(min.y);
+    const size_t last_row = GetRow(max.y);
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (size_t column = first_column; column <= last_column; ++column) {
+            const Cell& cell = cells_[GetCellIndex(column, row)];
+            routes.insert(routes.end(), cell.routes.begin(), cell.routes.end());
+            stops.insert(stops.end(), cell.stops.begin(), cell.stops.end());
+        }
+    }
+    std::sort(routes.begin(), routes.end());
+    routes.erase(std::unique(routes.begin(), routes.end()), routes.end());
+    std::sort(stops.begin(), stops.end());
+}
+
+size_t SpatialGrid::GetColumn(double x) const {
+    return ClampCell(x / cell_width_);
+}
 
-        svg::Text underlayer = stop_name;
-        underlayer.SetFillColor(render_settings_.underlayer_color)
-            .SetStrokeColor(render_settings_.underlayer_color)
-            .SetStrokeWidth(render_settings_.underlayer_width)
-            .SetStrokeLineCap(render_settings_.stroke_linecap)
-            .SetStrokeLineJoin(render_settings_.stroke_linejoin);
-        
-        objects_to_draw_.Add(underlayer);
-        objects_to_draw_.Add(stop_name);
+size_t SpatialGrid::GetRow(double y) const {
+    return ClampCell(y / cell_height_);
+}
+
+size_t SpatialGrid::ClampCell(double position) const {
+    if (!(position > 0.)) {
+        return 0;
     }
+    return std::min(static_cast<size_t>(position), cells_per_side_ - 1);
+}
+
+size_t SpatialGrid::GetCellIndex(size_t column, size_t row) const {
+    return row * cells_per_side_ + column;
 }
 
-svg::Color MapRenderer::ProcessColorSetting(const json::Node color_node) {
+svg::Color MapRenderer::ProcessColorSetting(const json::Node& color_node) {
     if (color_node.IsString()) {
-        return color_node.AsString();
+        return std::string(color_node.AsString());
     } else if (color_node.IsArray()) {
         const json::Array& color_settings = color_node.AsArray();
         if (color_settings.size() == 4) {
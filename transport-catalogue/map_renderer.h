@@ -4,11 +4,15 @@
 #include "geo.h"
 #include "json.h"
 #include "svg.h"
+#include "thread_pool.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <deque>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 inline const double EPSILON = 1e-6;
@@ -22,7 +26,8 @@ public:
     template <typename PointInputIt>
     SphereProjector(PointInputIt points_begin, PointInputIt points_end,
                     double max_width, double max_height, double padding)
-    : padding_(padding) //
+    : offset_x_(padding)
+    , offset_y_(padding) //
     {
         if (points_begin == points_end) {
             return;
@@ -61,13 +66,23 @@ public:
 
     svg::Point operator()(geo::Coordinates coords) const {
         return {
-            (coords.lng - min_lon_) * zoom_coeff_ + padding_,
-            (max_lat_ - coords.lat) * zoom_coeff_ + padding_
+            (coords.lng - min_lon_) * zoom_coeff_ + offset_x_,
+            (max_lat_ - coords.lat) * zoom_coeff_ + offset_y_
         };
     }
 
+    // Та же проекция, увеличенная в scale раз так, что точка origin исходной проекции переходит в (0, 0)
+    SphereProjector Zoomed(double scale, svg::Point origin) const {
+        SphereProjector zoomed = *this;
+        zoomed.zoom_coeff_ *= scale;
+        zoomed.offset_x_ = (offset_x_ - origin.x) * scale;
+        zoomed.offset_y_ = (offset_y_ - origin.y) * scale;
+        return zoomed;
+    }
+
 private:
-    double padding_;
+    double offset_x_;
+    double offset_y_;
     double min_lon_ = 0;
     double max_lat_ = 0;
     double zoom_coeff_ = 0;
@@ -89,32 +104,137 @@ struct RenderSettings {
     svg::Color fill_color = std::monostate();
     svg::StrokeLineCap stroke_linecap = svg::StrokeLineCap::ROUND;
     svg::StrokeLineJoin stroke_linejoin = svg::StrokeLineJoin::ROUND;
+    double simplify_tolerance = 0.; // допустимое отклонение упрощённых линий маршрутов в пикселях; 0 — без упрощения
 };
 
-class MapRenderer : private svg::Document {
+// Равномерная сетка над плоскостью карты. В ячейке перечислены остановки, которые в неё попадают,
+// и маршруты, отрезки которых её задевают; по ней выбираются объекты, видимые в прямоугольнике
+class SpatialGrid {
 public:
+    SpatialGrid() = default;
+    SpatialGrid(double width, double height, size_t cells_per_side);
+
+    void AddStop(svg::Point point, size_t stop_index);
+    void AddRouteSegment(svg::Point from, svg::Point to, size_t route_index);
+    // Дописывает номера маршрутов и остановок, которые могут быть видны в прямоугольнике [min, max];
+    // номера упорядочены по возрастанию и не повторяются
+    void Query(svg::Point min, svg::Point max, std::vector<size_t>& routes, std::vector<size_t>& stops) const;
+
+private:
+    struct Cell {
+        std::vector<size_t> stops;
+        std::vector<size_t> routes;
+    };
+
+    double cell_width_ = 0.;
+    double cell_height_ = 0.;
+    size_t cells_per_side_ = 0;
+    std::vector<Cell> cells_;
+
+    size_t GetColumn(double x) const;
+    size_t GetRow(double y) const;
+    size_t ClampCell(double position) const;
+    size_t GetCellIndex(size_t column, size_t row) const;
+    void AddRouteToCell(size_t column, size_t row, size_t route_index);
+};
+
+// Номера точек ломаной, которые остаются после упрощения по Дугласу — Пекеру: отброшенные точки
+// отклоняются от упрощённой линии не больше чем на tolerance
+std::vector<uint32_t> SimplifyPolyline(const std::vector<svg::Point>& points, double tolerance);
+
+// Плитка карты: при увеличении в 2^zoom раз карта делится на 2^zoom × 2^zoom плиток,
+// x и y — номера столбца и строки, считая от левого верхнего угла
+struct TileId {
+    int zoom = 0;
+    int x = 0;
+    int y = 0;
+};
+
+class MapRenderer {
+public:
+    static constexpr int MAX_TILE_ZOOM = 20;
+
     MapRenderer() = default;
     void SetSettings(const json::Document& render_settings);
+    // Меняется при каждой смене настроек; вместе с версией каталога определяет, устарела ли карта
+    size_t GetSettingsVersion() const;
     void RenderMapObjects(const std::deque<transport::Bus>& buses);
+    // Забывает построенные объекты, чтобы следующий RenderMapObjects построил их заново
+    void ClearMapObjects();
     void DrawMap(std::ostream& output);
+    // При нескольких потоках объекты выводятся частями в отдельные буферы, которые затем
+    // склеиваются по порядку, поэтому текст совпадает с однопоточным
+    void DrawMap(std::string& output);
+    // При нескольких потоках слои карты и плиток строятся, а карта выводится в пуле рендерера
+    void SetThreadsCount(size_t threads_count);
+    // Карта и плитки выводятся в компактном SVG, где оформление задано классами CSS
+    void SetCompactSvg(bool compact);
+    // Рисует плитку той же карты, что и DrawMap, в размере всей карты: на неё попадают только объекты,
+    // задевающие плитку. Вызывается после RenderMapObjects; false, если такой плитки нет.
+    // Упрощённые для масштаба плитки линии запоминаются, поэтому вызовы нельзя выполнять одновременно
+    bool DrawTile(const TileId& tile, std::string& output);
 
 private:
-    RenderSettings render_settings_;
-    svg::Document objects_to_draw_;
-    bool has_objects_to_draw_ = false; 
-    void RenderRoutes(std::vector<const transport::Bus*>& routes,
-                  const SphereProjector& proj);
+    static constexpr size_t DRAW_CHUNK_SIZE = 4096;
+    static constexpr size_t MAX_GRID_CELLS_PER_SIDE = 256;
+    // средняя ширина символа Verdana в долях размера шрифта, с запасом на жирное начертание
+    static constexpr double LABEL_CHAR_WIDTH = 0.7;
+    // с меньшим числом маршрутов и остановок слои быстрее построить подряд
+    static constexpr size_t PARALLEL_LAYERS_MIN_OBJECTS = 1024;
+
+    // Стили сцены; у маршрутов свой стиль для каждого цвета палитры
+    struct SceneStyles {
+        std::vector<svg::Scene::StyleId> route_lines;
+        std::vector<svg::Scene::TextStyleId> route_labels;
+        svg::Scene::TextStyleId route_label_underlayer = 0;
+        svg::Scene::StyleId stop_symbol = 0;
+        svg::Scene::TextStyleId stop_label = 0;
+        svg::Scene::TextStyleId stop_label_underlayer = 0;
+    };
 
-    void RenderRoutesNames(std::vector<const transport::Bus*>& routes,
-                        const SphereProjector& proj);
-
-    void RenderStopsSymbols(std::vector<const transport::Stop*> stops,
-                         const SphereProjector& proj);
-
-    void RenderStopsNames(std::vector<const transport::Stop*> stops,
-                       const SphereProjector& proj);
-
-    svg::Color ProcessColorSetting(const json::Node color_node);
+    RenderSettings render_settings_;
+    // Тексты сцены ссылаются на названия остановок и маршрутов в каталоге
+    svg::Scene objects_to_draw_;
+    // Номера точек ломаной маршрута, оставшихся после упрощения, для каждого маршрута
+    using RoutesLod = std::vector<std::vector<uint32_t>>;
+
+    // непустые маршруты и их остановки в порядке вывода; слои карты и плиток ссылаются на них по номерам
+    std::vector<const transport::Bus*> routes_;
+    std::vector<const transport::Stop*> stops_;
+    std::optional<SphereProjector> projector_;
+    SpatialGrid grid_;
+    bool has_grid_ = false;
+    // на сколько самая длинная подпись может выступать от точки привязки; считается вместе с сеткой
+    double label_extent_ = 0.;
+    // упрощённые линии для каждого уровня увеличения, считаются при первой нужде
+    std::vector<std::optional<RoutesLod>> routes_lods_;
+    bool has_objects_to_draw_ = false;
+    size_t settings_version_ = 0;
+    size_t threads_count_ = 1;
+    // создаётся в SetThreadsCount, если потоков больше одного
+    std::unique_ptr<concurrency::ThreadPool> pool_;
+    bool compact_svg_ = false;
+    void BuildGrid();
+    double EstimateLabelExtent() const;
+    void RenderScene(svg::Scene& scene, const std::vector<size_t>& routes, const std::vector<size_t>& stops,
+                     const SphereProjector& proj, const RoutesLod* lod) const;
+    const RoutesLod* GetRoutesLod(int zoom);
+    SceneStyles AddStyles(svg::Scene& scene) const;
+
+    void RenderRoutes(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& routes,
+                      const SphereProjector& proj, const RoutesLod* lod) const;
+
+    void RenderRoutesNames(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& routes,
+                           const SphereProjector& proj) const;
+
+    void RenderStopsSymbols(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& stops,
+                            const SphereProjector& proj) const;
+
+    void RenderStopsNames(svg::Scene& scene, const SceneStyles& styles, const std::vector<size_t>& stops,
+                          const SphereProjector& proj) const;
+
+    svg::PathStyle MakeUnderlayerStyle() const;
+    svg::Color ProcessColorSetting(const json::Node& color_node);
 
 };
 
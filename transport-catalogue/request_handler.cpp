@@ -18,9 +18,68 @@ const std::set<std::string_view>* RequestHandler::GetBusesByStop(const std::stri
     return db_.GetBusesListForStop(stop_name);
 }
 
-void RequestHandler::RenderMap(std::ostream& output) {
+const RequestHandler::RenderedMap& RequestHandler::GetMap() {
+    std::lock_guard lock(render_mutex_);
+    UpdateMapObjects();
+    if (!rendered_map_) {
+        std::string svg;
+        renderer_.DrawMap(svg);
+        rendered_map_ = MakeRenderedMap(std::move(svg));
+    }
+    return *rendered_map_;
+}
+
+std::shared_ptr<const RequestHandler::RenderedMap> RequestHandler::GetMapTile(const map_renderer::TileId& tile) {
+    std::lock_guard lock(render_mutex_);
+    UpdateMapObjects();
+    const TileKey key{tile.zoom, tile.x, tile.y};
+    if (auto it = tiles_index_.find(key); it != tiles_index_.end()) {
+        tiles_.splice(tiles_.begin(), tiles_, it->second);
+        return it->second->second;
+    }
+
+    std::string svg;
+    if (!renderer_.DrawTile(tile, svg)) {
+        return nullptr;
+    }
+    tiles_.emplace_front(key, std::make_shared<const RenderedMap>(MakeRenderedMap(std::move(svg))));
+    tiles_index_[key] = tiles_.begin();
+    if (tiles_.size() > TILE_CACHE_SIZE) {
+        tiles_index_.erase(tiles_.back().first);
+        tiles_.pop_back();
+    }
+    return tiles_.front().second;
+}
+
+// Перестраивает объекты карты, если каталог или настройки отрисовки изменились, и сбрасывает
+// нарисованные по старым объектам карту и плитки
+void RequestHandler::UpdateMapObjects() {
+    if (has_map_objects_ && catalogue_version_ == db_.GetVersion()
+        && settings_version_ == renderer_.GetSettingsVersion()) {
+        return;
+    }
+    rendered_map_.reset();
+    tiles_.clear();
+    tiles_index_.clear();
+
+    renderer_.ClearMapObjects();
     renderer_.RenderMapObjects(db_.GetRoutesList());
-    renderer_.DrawMap(output);
+    has_map_objects_ = true;
+    catalogue_version_ = db_.GetVersion();
+    settings_version_ = renderer_.GetSettingsVersion();
+}
+
+RequestHandler::RenderedMap RequestHandler::MakeRenderedMap(std::string svg) {
+    RenderedMap map;
+    map.svg = std::move(svg);
+    json::Writer json_text(json::PrintSettings{}, 0);
+    json_text.String(map.svg);
+    map.json = json_text.ExtractFragment();
+    return map;
+}
+
+void RequestHandler::RenderMap(std::ostream& output) {
+    output << GetMap().svg;
 }
 
 } // namespace transport::infrastructure
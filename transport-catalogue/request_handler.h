@@ -4,8 +4,15 @@
 #include "map_renderer.h"
 
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <unordered_set>
 
 namespace transport {
@@ -14,18 +21,49 @@ namespace handler {
 
 using namespace transport;
 
+// Константные методы только читают каталог и могут вызываться из нескольких потоков одновременно.
+// Карта строится под мьютексом, поэтому GetMap и RenderMap тоже можно вызывать из разных потоков
 class RequestHandler {
 public:
+    // SVG карты и та же строка, уже записанная как значение JSON
+    struct RenderedMap {
+        std::string svg;
+        std::string json;
+    };
+
     RequestHandler(const TransportCatalogue& db, map_renderer::MapRenderer& renderer);
 
     const Bus* GetBusStat(const std::string_view& bus_name) const;
     const std::set<std::string_view>* GetBusesByStop(const std::string_view& stop_name) const;
 
+    // Карта строится при первом запросе и перестраивается, только если с тех пор изменились
+    // каталог или настройки отрисовки. Ссылка действительна до такого изменения
+    const RenderedMap& GetMap();
     void RenderMap(std::ostream& output);
+    // Плитка карты; nullptr, если такой плитки нет. Последние нарисованные плитки хранятся в кэше,
+    // который сбрасывается вместе с картой
+    std::shared_ptr<const RenderedMap> GetMapTile(const map_renderer::TileId& tile);
 
 private:
+    static constexpr size_t TILE_CACHE_SIZE = 256;
+
+    using TileKey = std::tuple<int, int, int>;
+    using TileCacheEntry = std::pair<TileKey, std::shared_ptr<const RenderedMap>>;
+
     const TransportCatalogue& db_;
     map_renderer::MapRenderer& renderer_;
+    std::mutex render_mutex_;
+    std::optional<RenderedMap> rendered_map_;
+    size_t catalogue_version_ = 0;
+    size_t settings_version_ = 0;
+    bool has_map_objects_ = false;
+    // плитки от недавно запрошенных к давно запрошенным
+    std::list<TileCacheEntry> tiles_;
+    std::map<TileKey, std::list<TileCacheEntry>::iterator> tiles_index_;
+
+    // Вызывается под render_mutex_
+    void UpdateMapObjects();
+    static RenderedMap MakeRenderedMap(std::string svg);
 };
 
 
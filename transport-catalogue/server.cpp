@@ -0,0 +1,438 @@
+#include "server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <future>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+namespace transport {
+
+namespace server {
+
+namespace {
+
+// Идентификаторы служебных дескрипторов в epoll; клиентские соединения нумеруются с нуля
+constexpr uint64_t LISTEN_ID = UINT64_MAX;
+constexpr uint64_t WAKEUP_ID = UINT64_MAX - 1;
+constexpr uint64_t SIGNAL_ID = UINT64_MAX - 2;
+
+constexpr uint32_t READ_EVENTS = EPOLLIN;
+constexpr uint32_t WRITE_EVENTS = EPOLLOUT;
+
+sigset_t GetStopSignals() {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    return stop_signals;
+}
+
+[[noreturn]] void ThrowSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Закрывает дескриптор при выходе из области видимости, в том числе по исключению
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd)
+        : fd_(fd) {
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    ~FileDescriptor() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+// Выполняет действие при выходе из области видимости
+template <typename Action>
+class ScopeExit {
+public:
+    explicit ScopeExit(Action action)
+        : action_(std::move(action)) {
+    }
+    ScopeExit(const ScopeExit&) = delete;
+    ScopeExit& operator=(const ScopeExit&) = delete;
+    ~ScopeExit() {
+        action_();
+    }
+
+private:
+    Action action_;
+};
+
+void AddToEpoll(int epoll_fd, int fd, uint64_t id, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ThrowSystemError("epoll_ctl"s);
+    }
+}
+
+std::string_view TrimLine(std::string_view line) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+        line.remove_suffix(1);
+    }
+    while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) {
+        line.remove_prefix(1);
+    }
+    return line;
+}
+
+} // namespace
+
+void BlockStopSignals() {
+    const sigset_t stop_signals = GetStopSignals();
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+}
+
+Server::Server(json_reader::JsonReader& reader, size_t threads_count)
+    : reader_(reader)
+    , threads_count_(std::max<size_t>(threads_count, 1)) {
+}
+
+// Ошибка разбора или неизвестный тип запроса не прерывают работу: клиент получает error_message
+std::string Server::Answer(std::string_view line) const {
+    json::PrintSettings settings;
+    settings.compact = true;
+
+    std::string error_message = "Unknown request type"s;
+    try {
+        const json::Document request = json::Load(line);
+        std::string answer = reader_.AnswerRequest(request.GetRoot().AsDict(), settings);
+        if (!answer.empty()) {
+            return answer;
+        }
+    } catch (const std::exception& e) {
+        error_message = e.what();
+    }
+    return MakeErrorAnswer(error_message);
+}
+
+std::string Server::MakeErrorAnswer(const std::string& error_message) {
+    json::PrintSettings settings;
+    settings.compact = true;
+    json::Writer error(settings, 0);
+    error.StartDict();
+    error.Key("error_message"sv);
+    error.String(error_message);
+    error.EndDict();
+    return error.ExtractFragment();
+}
+
+// Вызывается из потоков пула; ответ забирает цикл epoll по сигналу wakeup_fd_
+void Server::AddCompletion(Completion completion) {
+    {
+        std::lock_guard lock(completions_mutex_);
+        completions_.push_back(std::move(completion));
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+}
+
+void Server::ServeStream(std::istream& input, std::ostream& output) {
+    concurrency::ThreadPool pool(threads_count_);
+    std::deque<std::future<std::string>> pending;
+    auto write_pending = [&pending, &output] {
+        for (; !pending.empty(); pending.pop_front()) {
+            output << pending.front().get() << '\n';
+        }
+        output.flush();
+    };
+
+    for (std::string line; std::getline(input, line);) {
+        if (TrimLine(line).empty()) {
+            continue;
+        }
+        pending.push_back(pool.Submit([this, line = std::move(line)] {
+            return Answer(line);
+        }));
+        // пока во входном буфере есть запросы, ответы копятся, иначе клиент ждёт ответа
+        if (input.rdbuf()->in_avail() <= 0 || pending.size() >= MAX_PENDING_ANSWERS) {
+            write_pending();
+        }
+    }
+    write_pending();
+}
+
+void Server::ServeUnixSocket(const std::string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long: "s + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // сигналы завершения принимаются через signalfd; маску нужно установить до запуска потоков пула.
+    // Потоки, запущенные раньше, её не наследуют, поэтому их закрывает BlockStopSignals
+    const sigset_t stop_signals = GetStopSignals();
+    sigset_t old_signals;
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+    // ресурсы освобождаются в обратном порядке, и маска сигналов восстанавливается последней
+    const ScopeExit restore_signals([&old_signals] {
+        pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+    });
+
+    const FileDescriptor listen_fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (listen_fd.Get() < 0) {
+        ThrowSystemError("socket"s);
+    }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listen_fd.Get(), SOMAXCONN) < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to listen on "s + socket_path);
+    }
+    const ScopeExit remove_socket([&socket_path] {
+        unlink(socket_path.c_str());
+    });
+
+    const FileDescriptor epoll_fd(epoll_create1(EPOLL_CLOEXEC));
+    const FileDescriptor wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    const FileDescriptor signal_fd(signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (epoll_fd.Get() < 0 || wakeup_fd.Get() < 0 || signal_fd.Get() < 0) {
+        ThrowSystemError("Failed to create server descriptors"s);
+    }
+    epoll_fd_ = epoll_fd.Get();
+    wakeup_fd_ = wakeup_fd.Get();
+    // соединения закрываются раньше epoll и до того, как дескрипторы сервера станут недействительными
+    const ScopeExit close_connections([this] {
+        while (!connections_.empty()) {
+            CloseConnection(connections_.begin()->first);
+        }
+        completions_.clear();
+        epoll_fd_ = -1;
+        wakeup_fd_ = -1;
+    });
+    AddToEpoll(epoll_fd_, listen_fd.Get(), LISTEN_ID, EPOLLIN);
+    AddToEpoll(epoll_fd_, wakeup_fd_, WAKEUP_ID, EPOLLIN);
+    AddToEpoll(epoll_fd_, signal_fd.Get(), SIGNAL_ID, EPOLLIN);
+
+    // пул разрушается первым: его задачи пишут в wakeup_fd_
+    concurrency::ThreadPool pool(threads_count_);
+    std::vector<epoll_event> events(256);
+    for (bool running = true; running;) {
+        const int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("epoll_wait"s);
+        }
+        for (int i = 0; i < count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID) {
+                AcceptClients(listen_fd.Get());
+            } else if (id == WAKEUP_ID) {
+                CollectCompletions(pool);
+            } else if (id == SIGNAL_ID) {
+                // сигнал нужно вычитать, иначе он сработает после восстановления маски
+                signalfd_siginfo info{};
+                [[maybe_unused]] ssize_t size = read(signal_fd.Get(), &info, sizeof(info));
+                running = false;
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                CloseConnection(id);
+            } else {
+                if (events[i].events & EPOLLIN) {
+                    ReadRequests(id, pool);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    WriteAnswers(id, pool);
+                }
+            }
+        }
+    }
+}
+
+void Server::AcceptClients(int listen_fd) {
+    while (true) {
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        const uint64_t id = next_connection_id_++;
+        Connection& connection = connections_[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        AddToEpoll(epoll_fd_, fd, id, connection.events);
+    }
+}
+
+// За один вызов читается не больше MAX_READ_SIZE байт, чтобы клиент, который пишет без остановки,
+// не занимал цикл; остаток будет прочитан по следующему событию
+void Server::ReadRequests(uint64_t connection_id, concurrency::ThreadPool& pool) {
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = it->second;
+
+    char chunk[READ_CHUNK_SIZE];
+    for (size_t read_size = 0; read_size < MAX_READ_SIZE;) {
+        const ssize_t size = read(connection.fd, chunk, sizeof(chunk));
+        if (size > 0) {
+            connection.input.append(chunk, static_cast<size_t>(size));
+            read_size += static_cast<size_t>(size);
+            continue;
+        }
+        if (size == 0) {
+            connection.input_closed = true;
+            connection.input += '\n';
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            CloseConnection(connection_id);
+            return;
+        }
+        break;
+    }
+
+    WriteAnswers(connection_id, pool);
+}
+
+// Каждая полная строка становится задачей пула; ответ вернётся в цикл через wakeup_fd_.
+// Пока соединение перегружено, строки остаются во входном буфере. Слишком длинная незавершённая
+// строка получает ответ с ошибкой после ответов на предыдущие запросы, а чтение прекращается
+void Server::SubmitRequests(uint64_t connection_id, Connection& connection, concurrency::ThreadPool& pool) {
+    size_t line_begin = 0;
+    for (size_t line_end; !IsOverloaded(connection)
+             && (line_end = connection.input.find('\n', line_begin)) != std::string::npos;
+         line_begin = line_end + 1) {
+        const std::string_view line = TrimLine(std::string_view(connection.input).substr(line_begin, line_end - line_begin));
+        if (line.empty()) {
+            continue;
+        }
+        pool.Submit([this, connection_id, index = connection.next_request++, request = std::string(line)] {
+            AddCompletion({connection_id, index, Answer(request)});
+        });
+    }
+    connection.input.erase(0, line_begin);
+
+    if (!connection.input_closed && connection.input.size() > MAX_REQUEST_LINE_SIZE
+        && connection.input.find('\n') == std::string::npos) {
+        connection.input.clear();
+        connection.input_closed = true;
+        AddCompletion({connection_id, connection.next_request++, MakeErrorAnswer("Request line is too long"s)});
+    }
+}
+
+// Готовые ответы переносятся в выходные буферы соединений строго по порядку запросов
+void Server::CollectCompletions(concurrency::ThreadPool& pool) {
+    uint64_t counter = 0;
+    [[maybe_unused]] ssize_t size = read(wakeup_fd_, &counter, sizeof(counter));
+
+    std::vector<Completion> completions;
+    {
+        std::lock_guard lock(completions_mutex_);
+        completions.swap(completions_);
+    }
+
+    std::vector<uint64_t> updated;
+    for (Completion& completion : completions) {
+        auto it = connections_.find(completion.connection_id);
+        if (it == connections_.end()) {
+            continue;
+        }
+        Connection& connection = it->second;
+        connection.ready_answers.emplace(completion.request_index, std::move(completion.answer));
+        auto ready = connection.ready_answers.begin();
+        while (ready != connection.ready_answers.end() && ready->first == connection.next_answer) {
+            connection.output += ready->second;
+            connection.output += '\n';
+            ready = connection.ready_answers.erase(ready);
+            ++connection.next_answer;
+        }
+        updated.push_back(completion.connection_id);
+    }
+
+    for (uint64_t connection_id : updated) {
+        WriteAnswers(connection_id, pool);
+    }
+}
+
+// После вывода ответов соединение может освободиться, и тогда отложенные строки отправляются в пул
+void Server::WriteAnswers(uint64_t connection_id, concurrency::ThreadPool& pool) {
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    Connection& connection = it->second;
+
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        const ssize_t size = send(connection.fd, connection.output.data() + written,
+                                  connection.output.size() - written, MSG_NOSIGNAL);
+        if (size > 0) {
+            written += static_cast<size_t>(size);
+        } else if (size < 0 && errno == EINTR) {
+            continue;
+        } else if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            CloseConnection(connection_id);
+            return;
+        }
+    }
+    connection.output.erase(0, written);
+    SubmitRequests(connection_id, connection, pool);
+
+    if (connection.input_closed && connection.input.empty() && connection.output.empty()
+        && connection.next_answer == connection.next_request) {
+        CloseConnection(connection_id);
+        return;
+    }
+    UpdateEvents(connection_id, connection);
+}
+
+// Чтение прекращается после конца ввода и пока соединение перегружено, запись ждёт готовности сокета,
+// только пока есть невыведенные ответы
+void Server::UpdateEvents(uint64_t connection_id, Connection& connection) {
+    const bool reading = !connection.input_closed && !IsOverloaded(connection);
+    const uint32_t events = (reading ? READ_EVENTS : 0u) | (connection.output.empty() ? 0u : WRITE_EVENTS);
+    if (events == connection.events) {
+        return;
+    }
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = connection_id;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
+
+// Клиент, который пишет запросы и не читает ответы, не должен копить их в памяти сервера без предела
+bool Server::IsOverloaded(const Connection& connection) {
+    return connection.next_request - connection.next_answer >= MAX_CONNECTION_PENDING_ANSWERS
+        || connection.output.size() >= MAX_PENDING_OUTPUT;
+}
+
+void Server::CloseConnection(uint64_t connection_id) {
+    auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+        return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    connections_.erase(it);
+}
+
+} // namespace transport::server
+} // namespace transport
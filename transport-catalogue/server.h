@@ -0,0 +1,93 @@
+#pragma once
+
+#include "json_reader.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+namespace server {
+
+// Блокирует SIGINT и SIGTERM в вызывающем потоке. Вызывается до запуска первого пула потоков, чтобы
+// маску унаследовали все потоки: иначе сигнал может достаться потоку пула и завершить процесс,
+// минуя signalfd в ServeUnixSocket
+void BlockStopSignals();
+
+// Отвечает на stat-запросы по уже построенному каталогу. Запросы и ответы передаются
+// построчно (NDJSON): каждая строка — один запрос, ответы идут в порядке запросов.
+// Запросы обрабатываются в пуле потоков, ввод-вывод — в одном потоке
+class Server {
+public:
+    Server(json_reader::JsonReader& reader, size_t threads_count);
+
+    // Цикл epoll для клиентов Unix-сокета; завершается по SIGINT или SIGTERM.
+    // Если в процессе уже работают другие потоки, сигналы должны быть заблокированы через BlockStopSignals
+    void ServeUnixSocket(const std::string& socket_path);
+
+    // Запросы читаются из input до конца потока. Ответы выводятся, как только
+    // во входном буфере не остаётся непрочитанных запросов
+    void ServeStream(std::istream& input, std::ostream& output);
+
+private:
+    static constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MAX_PENDING_ANSWERS = 4096;
+    // Соединение не читается, пока у него столько запросов без выведенного ответа или столько невыведенных байт.
+    // Соединений может быть много, поэтому запас на каждое меньше, чем у ServeStream
+    static constexpr size_t MAX_CONNECTION_PENDING_ANSWERS = 256;
+    static constexpr size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+    static constexpr size_t MAX_READ_SIZE = 16 * READ_CHUNK_SIZE;
+    // Незавершённая строка длиннее этого считается ошибкой: клиент получает ответ с ошибкой, и соединение закрывается
+    static constexpr size_t MAX_REQUEST_LINE_SIZE = 1024 * 1024;
+
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        uint64_t next_request = 0;
+        uint64_t next_answer = 0;
+        std::map<uint64_t, std::string> ready_answers;
+        bool input_closed = false;
+        uint32_t events = 0;
+    };
+
+    struct Completion {
+        uint64_t connection_id = 0;
+        uint64_t request_index = 0;
+        std::string answer;
+    };
+
+    json_reader::JsonReader& reader_;
+    size_t threads_count_;
+
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    uint64_t next_connection_id_ = 0;
+    std::unordered_map<uint64_t, Connection> connections_;
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+
+    std::string Answer(std::string_view line) const;
+    static std::string MakeErrorAnswer(const std::string& error_message);
+    void AddCompletion(Completion completion);
+
+    void AcceptClients(int listen_fd);
+    void ReadRequests(uint64_t connection_id, concurrency::ThreadPool& pool);
+    void SubmitRequests(uint64_t connection_id, Connection& connection, concurrency::ThreadPool& pool);
+    void CollectCompletions(concurrency::ThreadPool& pool);
+    void WriteAnswers(uint64_t connection_id, concurrency::ThreadPool& pool);
+    static bool IsOverloaded(const Connection& connection);
+    void UpdateEvents(uint64_t connection_id, Connection& connection);
+    void CloseConnection(uint64_t connection_id);
+};
+
+} // namespace transport::server
+} // namespace transport
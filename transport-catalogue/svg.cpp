@@ -1,41 +1,57 @@
 #include "svg.h"
 
+#include <algorithm>
+#include <charconv>
+#include <iterator>
 #include <sstream>
 
 namespace svg {
 
 using namespace std::literals;
 
-void EncodeText(std::ostream& out, std::string_view text) {
-
-    for (char ch : text) {
-        switch (ch) {
-            case '"':
-                out << "&quot;"sv;
-                break;
-            case '<':
-                out << "&lt;"sv;
-                break;
-            case '>':
-                out << "&gt;"sv;
-                break;
-            case '\'':
-                out << "&apos;"sv;
-                break;
-            case '&':
-                out << "&amp;"sv;
-                break;
-            default:
-                out << ch;
-                break;
+namespace {
+
+constexpr std::string_view SPECIAL_CHARS = "\"<>'&"sv;
+
+std::string_view EscapeChar(char ch) {
+    switch (ch) {
+        case '"':
+            return "&quot;"sv;
+        case '<':
+            return "&lt;"sv;
+        case '>':
+            return "&gt;"sv;
+        case '\'':
+            return "&apos;"sv;
+        default:
+            return "&amp;"sv;
+    }
+}
+
+// Передаёт в append куски текста: участки без спецсимволов целиком, а спецсимволы — уже заменёнными
+template <typename Append>
+void EncodeTextParts(std::string_view text, Append append) {
+    while (!text.empty()) {
+        const size_t special_pos = std::min(text.find_first_of(SPECIAL_CHARS), text.size());
+        append(text.substr(0, special_pos));
+        if (special_pos == text.size()) {
+            break;
         }
+        append(EscapeChar(text[special_pos]));
+        text.remove_prefix(special_pos + 1);
     }
 }
 
+} // namespace
+
+void EncodeText(std::string& out, std::string_view text) {
+    EncodeTextParts(text, [&out](std::string_view part) {
+        out += part;
+    });
+}
+
 std::string ColorGetter::operator()(std::monostate) const {
-    std::ostringstream out;
-    out << "none"s;
-    return out.str();
+    return "none"s;
 }
 
 std::string ColorGetter::operator()(const std::string color) const {
@@ -101,121 +117,280 @@ std::ostream& operator<<(std::ostream& out, const StrokeLineJoin& line_join) {
     return out;
 }
 
-void Object::Render(const RenderContext& context) const {
-    context.RenderIndent();
+void RenderAttrs(std::ostream& out, const PathStyle& style) {
+    if (style.fill_color) {
+        out << " fill=\""sv << *style.fill_color << "\""sv;
+    }
+    if (style.stroke_color) {
+        out << " stroke=\""sv << *style.stroke_color << "\""sv;
+    }
+    if (style.stroke_width) {
+        out << " stroke-width=\""sv << *style.stroke_width << "\""sv;
+    }
+    if (style.line_cap) {
+        out << " stroke-linecap=\""sv << *style.line_cap << "\""sv;
+    }
+    if (style.line_join) {
+        out << " stroke-linejoin=\""sv << *style.line_join << "\""sv;
+    }
+}
 
-    // Делегируем вывод тега своим подклассам
-    RenderObject(context);
+// ---------- Scene ------------------
 
-    context.out << std::endl;
-}
+namespace {
 
-// ---------- Circle ------------------
+// Записывает число так же, как operator<< с настройками потока по умолчанию
+void AppendNumber(std::string& out, double value) {
+    char chars[32];
+    auto [end, ec] = std::to_chars(std::begin(chars), std::end(chars), value, std::chars_format::general, 6);
+    out.append(chars, static_cast<size_t>(end - chars));
+}
 
-Circle& Circle::SetCenter(Point center)  {
-    center_ = center;
-    return *this;
+void AppendPoint(std::string& out, Point point, std::string_view separator) {
+    AppendNumber(out, point.x);
+    out += separator;
+    AppendNumber(out, point.y);
 }
 
-Circle& Circle::SetRadius(double radius)  {
-    radius_ = radius;
-    return *this;
+// Те же свойства, что и в RenderAttrs, в виде объявлений CSS. В таблице стилей длины указываются с единицами
+void RenderCss(std::ostream& out, const PathStyle& style) {
+    if (style.fill_color) {
+        out << "fill:"sv << *style.fill_color << ';';
+    }
+    if (style.stroke_color) {
+        out << "stroke:"sv << *style.stroke_color << ';';
+    }
+    if (style.stroke_width) {
+        out << "stroke-width:"sv << *style.stroke_width << "px;"sv;
+    }
+    if (style.line_cap) {
+        out << "stroke-linecap:"sv << *style.line_cap << ';';
+    }
+    if (style.line_join) {
+        out << "stroke-linejoin:"sv << *style.line_join << ';';
+    }
 }
 
-void Circle::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\""sv;
-    out << " r=\""sv << radius_ << "\""sv;
-    RenderAttrs(out);
-    out << "/>"sv;
+} // namespace
+
+Scene::StyleId Scene::AddStyle(PathStyle style) {
+    const StyleId id = styles_.size();
+    std::ostringstream attrs;
+    if (compact_) {
+        std::ostringstream rule;
+        rule << ".s"sv << id << '{';
+        RenderCss(rule, style);
+        rule << '}';
+        EncodeText(style_sheet_, rule.str());
+        attrs << " class=\"s"sv << id << "\""sv;
+    } else {
+        RenderAttrs(attrs, style);
+    }
+    styles_.push_back(std::move(attrs).str());
+    return id;
 }
 
-Polyline& Polyline::AddPoint(Point point) {
-    points_.push_back(point);
-    return *this;
-}
-
-void Polyline::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    out << "<polyline points=\""sv;
-    bool need_space = false;
-    for (const Point& point : points_) {
-        if (need_space) {
-            out << ' ';
-        } else {
-            need_space = true;
+Scene::TextStyleId Scene::AddTextStyle(TextStyle style) {
+    const TextStyleId id = text_styles_.size();
+    std::ostringstream head;
+    head << "<text"sv;
+    std::ostringstream tail;
+    tail << "\""sv;
+    tail << " dx=\""sv << style.offset.x << "\" dy=\""sv << style.offset.y << "\""sv;
+
+    if (compact_) {
+        head << " class=\"t"sv << id << "\""sv;
+        std::ostringstream rule;
+        rule << ".t"sv << id << '{';
+        RenderCss(rule, style.path);
+        rule << "font-size:"sv << style.font_size << "px;"sv;
+        if (style.font_family) {
+            rule << "font-family:"sv << *style.font_family << ';';
+        }
+        if (style.font_weight) {
+            rule << "font-weight:"sv << *style.font_weight << ';';
+        }
+        rule << '}';
+        EncodeText(style_sheet_, rule.str());
+    } else {
+        RenderAttrs(head, style.path);
+        tail << " font-size=\""sv << style.font_size << "\""sv;
+        if (style.font_family) {
+            tail << " font-family=\""sv << *style.font_family << "\""sv;
+        }
+        if (style.font_weight) {
+            tail << " font-weight=\""sv << *style.font_weight << "\""sv;
         }
-        out << point.x << ","sv << point.y;
     }
-    out << "\""sv;
-    RenderAttrs(out);
-    out << "/>"sv;
+    head << " x=\""sv;
+    tail << ">"sv;
+
+    text_styles_.push_back({std::move(head).str(), std::move(tail).str()});
+    return id;
 }
 
-Text& Text::SetPosition(Point pos) {
-    position_ = pos;
-    return *this;
+void Scene::SetCompact(bool compact) {
+    compact_ = compact;
 }
 
-Text& Text::SetOffset(Point offset) {
-    offset_ = offset;
-    return *this;
+void Scene::AddCircle(Point center, double radius, StyleId style) {
+    circles_.push_back({center, radius, style});
+    AddToRun(ObjectType::CIRCLE);
 }
 
-Text& Text::SetFontSize(uint32_t size) {
-    font_size_ = size;
-    return *this;
+void Scene::AddPolyline(StyleId style) {
+    polylines_.push_back({points_.size(), style});
+    AddToRun(ObjectType::POLYLINE);
 }
 
-Text& Text::SetFontFamily(std::string font_family) {
-    font_family_ = font_family;
-    return *this;
+void Scene::AddPoint(Point point) {
+    points_.push_back(point);
+    polylines_.back().points_end = points_.size();
 }
 
-Text& Text::SetFontWeight(std::string font_weight) {
-    font_weight_ = font_weight;
-    return *this;
+void Scene::AddText(Point position, std::string_view data, TextStyleId style) {
+    texts_.push_back({position, data, style});
+    AddToRun(ObjectType::TEXT);
 }
 
-Text& Text::SetData(std::string data) {
-    text_ = data;
-    return *this;
+void Scene::Append(const Scene& other) {
+    circles_.insert(circles_.end(), other.circles_.begin(), other.circles_.end());
+    const size_t points_offset = points_.size();
+    points_.insert(points_.end(), other.points_.begin(), other.points_.end());
+    for (PolylineItem polyline : other.polylines_) {
+        polyline.points_end += points_offset;
+        polylines_.push_back(polyline);
+    }
+    texts_.insert(texts_.end(), other.texts_.begin(), other.texts_.end());
+    for (const Run& run : other.runs_) {
+        if (runs_.empty() || runs_.back().type != run.type) {
+            runs_.push_back({run.type, 0});
+        }
+        runs_.back().count += run.count;
+    }
 }
 
-void Text::RenderObject(const RenderContext& context) const {
-    auto& out = context.out;
-    out << "<text"sv;
-    RenderAttrs(out);
-    out << " x=\""sv << position_.x << "\" y=\""sv << position_.y << "\""sv;
-    out << " dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << "\""sv;
-    out << " font-size=\""sv << font_size_ << "\""sv;
-    if (font_family_) {
-        out << " font-family=\""sv << *font_family_ << "\""sv;
+void Scene::Clear() {
+    style_sheet_.clear();
+    styles_.clear();
+    text_styles_.clear();
+    circles_.clear();
+    polylines_.clear();
+    points_.clear();
+    texts_.clear();
+    runs_.clear();
+}
+
+void Scene::AddToRun(ObjectType type) {
+    if (runs_.empty() || runs_.back().type != type) {
+        runs_.push_back({type, 0});
     }
+    ++runs_.back().count;
+}
 
-    if (font_weight_) {
-        out << " font-weight=\""sv << *font_weight_ << "\""sv;
+void Scene::Render(std::ostream& out) const {
+    std::string buffer;
+    Render(buffer);
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+void Scene::Render(std::string& buffer) const {
+    RenderHeader(buffer);
+    RenderObjects(buffer, 0, GetObjectsCount());
+    RenderFooter(buffer);
+}
+
+size_t Scene::GetObjectsCount() const {
+    return circles_.size() + polylines_.size() + texts_.size();
+}
+
+void Scene::RenderHeader(std::string& buffer) const {
+    if (compact_) {
+        buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv;
+        buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\"><style>"sv;
+        buffer += style_sheet_;
+        buffer += "</style>"sv;
+        return;
+    }
+    buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+    buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+}
+
+void Scene::RenderObjects(std::string& buffer, size_t begin, size_t end) const {
+    size_t circle_index = 0;
+    size_t polyline_index = 0;
+    size_t text_index = 0;
+    size_t index = 0;
+    for (const Run& run : runs_) {
+        if (index >= end) {
+            break;
+        }
+        // серии, целиком лежащие до begin, только сдвигают номера объектов своего типа
+        const size_t skipped = std::min(run.count, begin > index ? begin - index : 0);
+        size_t& type_index = run.type == ObjectType::CIRCLE ? circle_index
+                           : run.type == ObjectType::POLYLINE ? polyline_index
+                           : text_index;
+        type_index += skipped;
+        index += skipped;
+
+        for (size_t i = skipped; i < run.count && index < end; ++i, ++index) {
+            if (!compact_) {
+                buffer += "  "sv;
+            }
+            switch (run.type) {
+                case ObjectType::CIRCLE:
+                    RenderCircle(buffer, circles_[circle_index++]);
+                    break;
+                case ObjectType::POLYLINE: {
+                    const size_t points_begin = polyline_index == 0 ? 0 : polylines_[polyline_index - 1].points_end;
+                    RenderPolyline(buffer, points_begin, polylines_[polyline_index++]);
+                    break;
+                }
+                case ObjectType::TEXT:
+                    RenderText(buffer, texts_[text_index++]);
+                    break;
+            }
+            if (!compact_) {
+                buffer += '\n';
+            }
+        }
     }
-    out << ">"sv;
-    EncodeText(out, text_);
-    out << "</text>"sv;
 }
 
-void Document::AddPtr(std::unique_ptr<Object>&& obj) {
-    objects_.emplace_back(std::move(obj));
+void Scene::RenderFooter(std::string& buffer) const {
+    buffer += compact_ ? "</svg>"sv : "</svg>\n"sv;
 }
 
-// Выводит в ostream svg-представление документа
-void Document::Render(std::ostream& out) const {
-    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+void Scene::RenderCircle(std::string& out, const CircleItem& circle) const {
+    out += "<circle cx=\""sv;
+    AppendPoint(out, circle.center, "\" cy=\""sv);
+    out += "\" r=\""sv;
+    AppendNumber(out, circle.radius);
+    out += "\""sv;
+    out += styles_[circle.style];
+    out += "/>"sv;
+}
 
-    RenderContext ctx(out, 2, 2);
-    for (const auto& obj : objects_) {
-        obj->Render(ctx);
+void Scene::RenderPolyline(std::string& out, size_t points_begin, const PolylineItem& polyline) const {
+    out += "<polyline points=\""sv;
+    for (size_t i = points_begin; i < polyline.points_end; ++i) {
+        if (i != points_begin) {
+            out += ' ';
+        }
+        AppendPoint(out, points_[i], ","sv);
     }
+    out += "\""sv;
+    out += styles_[polyline.style];
+    out += "/>"sv;
+}
 
-    out << "</svg>\n"sv;
+void Scene::RenderText(std::string& out, const TextItem& text) const {
+    const PreparedTextStyle& style = text_styles_[text.style];
+    out += style.head;
+    AppendPoint(out, text.position, "\" y=\""sv);
+    out += style.tail;
+    EncodeText(out, text.data);
+    out += "</text>"sv;
 }
 
 }  // namespace svg
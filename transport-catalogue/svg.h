@@ -2,7 +2,6 @@
 
 #include <cstdint>
 #include <iostream>
-#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -11,7 +10,7 @@
 
 namespace svg {
 
-void EncodeText(std::ostream& out, std::string_view text);
+void EncodeText(std::string& out, std::string_view text);
 
 struct Point {
     Point() = default;
@@ -23,42 +22,6 @@ struct Point {
     double y = 0;
 };
 
-struct RenderContext {
-    RenderContext(std::ostream& out)
-        : out(out) {
-    }
-
-    RenderContext(std::ostream& out, int indent_step, int indent = 0)
-        : out(out)
-        , indent_step(indent_step)
-        , indent(indent) {
-    }
-
-    RenderContext Indented() const {
-        return {out, indent_step, indent + indent_step};
-    }
-
-    void RenderIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
-        }
-    }
-
-    std::ostream& out;
-    int indent_step = 0;
-    int indent = 0;
-};
-
-class Object {
-public:
-    void Render(const RenderContext& context) const;
-
-    virtual ~Object() = default;
-
-private:
-    virtual void RenderObject(const RenderContext& context) const = 0;
-};
-
 struct Rgb {
     Rgb() = default;
 
@@ -122,134 +85,115 @@ std::ostream& operator<<(std::ostream& out, const StrokeLineCap& line_cap);
 
 std::ostream& operator<<(std::ostream& out, const StrokeLineJoin& line_join);
 
-template <typename Owner>
-class PathProps {
-public:
-    Owner& SetFillColor(Color color) {
-        fill_color_ = std::move(color);
-        return AsOwner();
-    }
-
-    Owner& SetStrokeColor(Color color) {
-        stroke_color_ = std::move(color);
-        return AsOwner();
-    }
-
-    Owner& SetStrokeWidth(double width) {
-        stroke_width_ = width;
-        return AsOwner();
-    }
-
-    Owner& SetStrokeLineCap(StrokeLineCap line_cap) {
-        line_cap_ = line_cap;
-        return AsOwner();
-    }
-
-    Owner& SetStrokeLineJoin(StrokeLineJoin line_join) {
-        line_join_ = line_join;
-        return AsOwner();
-    }
-
-protected:
-    ~PathProps() = default;
-
-    void RenderAttrs(std::ostream& out) const {
-        if (fill_color_) {
-            out << " fill=\""sv << *fill_color_ << "\""sv;
-        }
-        if (stroke_color_) {
-            out << " stroke=\""sv << *stroke_color_ << "\""sv;
-        }
-        if (stroke_width_) {
-            out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
-        }
-        if (line_cap_) {
-            out << " stroke-linecap=\""sv << *line_cap_ << "\""sv;
-        }
-        if (line_join_) {
-            out << " stroke-linejoin=\""sv << *line_join_ << "\""sv;
-        }
-    }
-
-private:
-    Owner& AsOwner() {
-        return static_cast<Owner&>(*this);
-    }
-
-    std::optional<Color> fill_color_;
-    std::optional<Color> stroke_color_;
-    std::optional<double> stroke_width_;
-    std::optional<StrokeLineCap> line_cap_;
-    std::optional<StrokeLineJoin> line_join_;
+// Атрибуты заливки и обводки; выводятся только заданные
+struct PathStyle {
+    std::optional<Color> fill_color;
+    std::optional<Color> stroke_color;
+    std::optional<double> stroke_width;
+    std::optional<StrokeLineCap> line_cap;
+    std::optional<StrokeLineJoin> line_join;
 };
 
-class Circle final : public Object, public PathProps<Circle> {
-public:
-    Circle& SetCenter(Point center);
-    Circle& SetRadius(double radius);
-
-private:
-    void RenderObject(const RenderContext& context) const override;
+void RenderAttrs(std::ostream& out, const PathStyle& style);
 
-    Point center_;
-    double radius_ = 1.0;
+// Оформление текста без его положения и содержимого
+struct TextStyle {
+    PathStyle path;
+    Point offset;
+    uint32_t font_size = 1;
+    std::optional<std::string> font_family;
+    std::optional<std::string> font_weight;
 };
 
-class Polyline final : public Object, public PathProps<Polyline> {
+// SVG-документ из кругов, ломаных и текстов.
+// Объекты каждого типа лежат в своём массиве, точки всех ломаных — в одном общем, а стили добавляются
+// один раз и передаются объектам по номеру. Тексты хранятся как string_view, поэтому строки
+// должны оставаться доступными, пока сцена выводится.
+// Атрибуты стилей записываются в текст сразу при добавлении, а при выводе копируются вместе
+// с числами, записанными через to_chars, в один буфер
+class Scene {
 public:
-    Polyline& AddPoint(Point point);
-
-private:
-    void RenderObject(const RenderContext& context) const override;
-
-    std::vector<Point> points_;
-};
+    using StyleId = size_t;
+    using TextStyleId = size_t;
+
+    StyleId AddStyle(PathStyle style);
+    TextStyleId AddTextStyle(TextStyle style);
+    // Компактный вывод: оформление записывается один раз в блок <style>, объекты ссылаются на него
+    // через class, а между тегами нет отступов и переводов строк. Вызывается до добавления стилей
+    void SetCompact(bool compact);
+
+    void AddCircle(Point center, double radius, StyleId style);
+    // Начинает ломаную; её точки добавляются через AddPoint
+    void AddPolyline(StyleId style);
+    void AddPoint(Point point);
+    void AddText(Point position, std::string_view data, TextStyleId style);
+    // Дописывает объекты other после своих. Стили other не копируются: обе сцены должны
+    // получить одинаковые стили в одном порядке
+    void Append(const Scene& other);
+
+    void Clear();
+    void Render(std::ostream& out) const;
+    // Дописывает документ в конец buffer
+    void Render(std::string& buffer) const;
 
-class Text final : public Object, public PathProps<Text> {
-public:
-    Text& SetPosition(Point pos);
-    Text& SetOffset(Point offset);
-    Text& SetFontSize(uint32_t size);
-    Text& SetFontFamily(std::string font_family);
-    Text& SetFontWeight(std::string font_weight);
-    Text& SetData(std::string data);
+    // Документ можно выводить частями, в том числе из разных потоков: заголовок, затем объекты
+    // по диапазонам номеров в порядке вывода, затем окончание
+    size_t GetObjectsCount() const;
+    void RenderHeader(std::string& buffer) const;
+    void RenderObjects(std::string& buffer, size_t begin, size_t end) const;
+    void RenderFooter(std::string& buffer) const;
 
 private:
-    void RenderObject(const RenderContext& context) const override;
-
-    Point position_;
-    Point offset_;
-    uint32_t font_size_ = 1;
-    std::optional<std::string> font_weight_;
-    std::optional<std::string> font_family_;
-    std::string text_;
-
-};
-
-class ObjectContainer {
-public:
-    template <typename Obj>
-    void Add (Obj obj) {
-        AddPtr(std::make_unique<Obj>(std::move(obj)));
-    }
-
-    virtual void AddPtr(std::unique_ptr<Object>&& obj) = 0;
-};
-
-class Drawable {
-public:
-    virtual void Draw(ObjectContainer& objects) const = 0;
-
-    virtual ~Drawable() = default;
-};
-
-class Document : public ObjectContainer {
-public:
+    enum class ObjectType {
+        CIRCLE,
+        POLYLINE,
+        TEXT,
+    };
+
+    // Подряд идущие объекты одного типа; по ним восстанавливается порядок вывода
+    struct Run {
+        ObjectType type;
+        size_t count = 0;
+    };
+
+    struct CircleItem {
+        Point center;
+        double radius = 0.;
+        StyleId style = 0;
+    };
+
+    struct PolylineItem {
+        size_t points_end = 0;
+        StyleId style = 0;
+    };
+
+    struct TextItem {
+        Point position;
+        std::string_view data;
+        TextStyleId style = 0;
+    };
+
+    // Текст тега до значения x и после значения y
+    struct PreparedTextStyle {
+        std::string head;
+        std::string tail;
+    };
+
+    bool compact_ = false;
+    // правила CSS для компактного вывода, уже экранированные для XML
+    std::string style_sheet_;
+    std::vector<std::string> styles_;
+    std::vector<PreparedTextStyle> text_styles_;
+    std::vector<CircleItem> circles_;
+    std::vector<PolylineItem> polylines_;
+    std::vector<Point> points_;
+    std::vector<TextItem> texts_;
+    std::vector<Run> runs_;
 
-    void AddPtr(std::unique_ptr<Object>&& obj) override;
-    void Render(std::ostream& out) const;
-private:
-    std::vector<std::unique_ptr<Object>> objects_;
+    void AddToRun(ObjectType type);
+    void RenderCircle(std::string& out, const CircleItem& circle) const;
+    void RenderPolyline(std::string& out, size_t points_begin, const PolylineItem& polyline) const;
+    void RenderText(std::string& out, const TextItem& text) const;
 };
 
 }  // namespace svg
@@ -0,0 +1,61 @@
+#include "thread_pool.h"
+
+namespace concurrency {
+
+ThreadPool::ThreadPool(size_t threads_count) {
+    workers_.reserve(threads_count);
+    for (size_t i = 0; i < threads_count; ++i) {
+        workers_.emplace_back([this] {
+            Work();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopped_ = true;
+    }
+    has_tasks_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadsCount() const {
+    return workers_.size();
+}
+
+size_t ThreadPool::DefaultThreadsCount() {
+    const size_t threads_count = std::thread::hardware_concurrency();
+    return threads_count == 0 ? 1 : threads_count;
+}
+
+void ThreadPool::Push(std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    has_tasks_.notify_one();
+}
+
+// Оставшиеся в очереди задачи выполняются и после остановки пула
+void ThreadPool::Work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            has_tasks_.wait(lock, [this] {
+                return stopped_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+}  // namespace concurrency
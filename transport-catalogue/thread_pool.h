@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace concurrency {
+
+// Пул потоков с общей очередью задач. Результат задачи и её исключение передаются через std::future
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count = DefaultThreadsCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadsCount() const;
+
+    template <typename Task>
+    auto Submit(Task task) -> std::future<std::invoke_result_t<Task>> {
+        using Result = std::invoke_result_t<Task>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        Push([packaged] {
+            (*packaged)();
+        });
+        return result;
+    }
+
+    // Вызывает function(index) для всех index из [0, count). Потоки забирают индексы порциями
+    // по grain_size через общий счётчик, поэтому долгие вызовы не задерживают остальные потоки
+    template <typename Function>
+    void ParallelFor(size_t count, size_t grain_size, const Function& function) {
+        std::atomic_size_t next_index = 0;
+        std::vector<std::future<void>> workers;
+        workers.reserve(workers_.size());
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            workers.push_back(Submit([count, grain_size, &function, &next_index] {
+                for (size_t first = next_index.fetch_add(grain_size); first < count;
+                     first = next_index.fetch_add(grain_size)) {
+                    const size_t last = std::min(first + grain_size, count);
+                    for (size_t index = first; index < last; ++index) {
+                        function(index);
+                    }
+                }
+            }));
+        }
+        // прежде чем передать исключение дальше, нужно дождаться всех задач: они ссылаются на локальные данные
+        for (auto& worker : workers) {
+            worker.wait();
+        }
+        for (auto& worker : workers) {
+            worker.get();
+        }
+    }
+
+    static size_t DefaultThreadsCount();
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    bool stopped_ = false;
+
+    void Push(std::function<void()> task);
+    void Work();
+};
+
+}  // namespace concurrency
@@ -22,13 +22,16 @@ bool PairComp::operator()(const std::pair<const Stop*, const Stop*>& lhs,
 } // namespace transport::detail
 
 void TransportCatalogue::AddStop(Stop&& stop) {
+    stop.id = stops_.size();
     stops_.push_back(std::move(stop));
     stops_index_[stops_.back().name] = &stops_.back();
     stop_to_buses_index_[stops_.back().name];
+    ++version_;
 }
 
 void TransportCatalogue::SetDistance(const Stop* from_name, const Stop* to_name, int distance) {
     stops_distances_index_[{from_name, to_name}] = distance;
+    ++version_;
 }
 
 void TransportCatalogue::AddBus(std::string_view name, const std::vector<std::string_view>& route, bool is_round) {
@@ -55,20 +58,21 @@ void TransportCatalogue::AddBus(std::string_view name, const std::vector<std::st
     for (const auto& stop : added_bus_ptr->route) {
         stop_to_buses_index_[stop->name].insert(added_bus_ptr->name);
     }
+    ++version_;
 }
 
 const Bus* TransportCatalogue::GetBusInfo(std::string_view name) const {
-    if (buses_index_.find(name) != buses_index_.end()) {
-        return buses_index_.at(name);
-    }
-    return nullptr;
+    const auto it = buses_index_.find(name);
+    return it == buses_index_.end() ? nullptr : it->second;
 }
 
 const Stop* TransportCatalogue::GetStopInfo(std::string_view name) const {
-    if (stops_index_.find(name) != stops_index_.end()) {
-        return stops_index_.at(name);
-    }
-    return nullptr;
+    const auto it = stops_index_.find(name);
+    return it == stops_index_.end() ? nullptr : it->second;
+}
+
+size_t TransportCatalogue::GetVersion() const {
+    return version_;
 }
 
 const std::deque<Bus>& TransportCatalogue::GetRoutesList() const {
@@ -92,11 +96,8 @@ int TransportCatalogue::GetDistance(const Stop* from_name, const Stop* to_name)
 }
 
 const std::set<std::string_view>* TransportCatalogue::GetBusesListForStop(std::string_view name) const {
-    if (stop_to_buses_index_.find(name) == stop_to_buses_index_.end()) {
-        return nullptr;
-    }
-    
-    return &stop_to_buses_index_.at(name);
+    const auto it = stop_to_buses_index_.find(name);
+    return it == stop_to_buses_index_.end() ? nullptr : &it->second;
 }
 
 void TransportCatalogue::FillGeoLength(Bus& route) const {
@@ -39,8 +39,11 @@ public:
     const std::deque<Bus>& GetRoutesList() const;
     int GetDistance(const Stop* from_name, const Stop* to_name) const;
     const std::set<std::string_view>* GetBusesListForStop(std::string_view name) const;
+    // Меняется при каждом изменении каталога; по ней проверяется, не устарели ли построенные по каталогу данные
+    size_t GetVersion() const;
 
 private:
+    size_t version_ = 0;
     std::deque<Stop> stops_;
     std::deque<Bus> buses_;
     std::unordered_map<std::string_view, const Stop*> stops_index_;
@@ -33,6 +33,7 @@ public:
 
     explicit RoutesGraph(const transport::TransportCatalogue& db, const RouteSettings& settings);
 
+    // Только читает готовый граф и маршрутизатор, поэтому безопасен при вызове из нескольких потоков
     std::optional<Route>
     BuildRoute(const transport::Stop* from, const transport::Stop* to) const;
 